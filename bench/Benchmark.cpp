@@ -0,0 +1,437 @@
+#include "Action.h"
+#include "FacilityCatalog.h"
+#include "ScenarioGenerator.h"
+#include "SelectionPolicy.h"
+#include "Simulation.h"
+#include "TextWriter.h"
+#include "WeightedPolicy.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Benchmarks for the simulation core, run by "make bench":
+//     bench [--baseline <file>] [--filter <text>] [--min-time <ms>] [--tolerance <percent>]
+// Every benchmark repeats one operation until a run takes at least the minimum time, then reports
+// the time and the heap allocations (operator new calls) per operation as JSON on stdout. Given a
+// baseline, the output of an earlier run, each result also shows the baseline time and the change
+// against it; with a tolerance, a result slower than the baseline by more than that fails the run.
+// The configs come from ScenarioGenerator with its default seed.
+
+unordered_map<string, Simulation> backups; //Used by the backup and restore actions
+deque<shared_ptr<UndoRecord>> undoJournal;
+
+static atomic<bool> countingAllocations(false);
+static atomic<long long> allocations(0);
+
+//Out of line so the compiler does not pair these with the library's operator new and delete
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    if (countingAllocations.load(memory_order_relaxed))
+    {
+        allocations.fetch_add(1, memory_order_relaxed);
+    }
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+// What a benchmark sees: how many operations to run, and a stopwatch it pauses around setup work
+// that should not count
+class BenchmarkState
+{
+    public:
+        explicit BenchmarkState(long long iterations) : iterations(iterations), elapsed(0), startAllocations(0), allocated(0), started() {}
+
+        long long getIterations() const { return iterations; }
+
+        void resume()
+        {
+            startAllocations = allocations.load(memory_order_relaxed);
+            countingAllocations.store(true, memory_order_relaxed);
+            started = chrono::steady_clock::now();
+        }
+
+        void pause()
+        {
+            elapsed += chrono::steady_clock::now() - started;
+            countingAllocations.store(false, memory_order_relaxed);
+            allocated += allocations.load(memory_order_relaxed) - startAllocations;
+        }
+
+        double getSeconds() const { return chrono::duration<double>(elapsed).count(); }
+        long long getAllocations() const { return allocated; }
+
+    private:
+        long long iterations;
+        chrono::steady_clock::duration elapsed;
+        long long startAllocations;
+        long long allocated;
+        chrono::steady_clock::time_point started;
+};
+
+struct Benchmark
+{
+    string name;
+    //Runs state.getIterations() operations; the state is running when called and must be on return
+    void (*run)(BenchmarkState &state, int plans, int options);
+    int plans;
+    int options;
+};
+
+//Generated with one settlement per plan
+static ScenarioSettings makeSettings(int plans, int options)
+{
+    ScenarioSettings settings;
+    settings.settlements = plans;
+    settings.facilities = options;
+    settings.plans = plans;
+    return settings;
+}
+
+//A generated config in a temporary file; returns its path
+static string writeConfig(int plans, int options)
+{
+    char path[] = "/tmp/bench_configXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        throw runtime_error("Could not create a config file");
+    }
+    close(fd);
+    ofstream config(path);
+    TextWriter out(config.rdbuf());
+    ScenarioGenerator(makeSettings(plans, options)).writeConfig(out);
+    return path;
+}
+
+//A simulation loaded from a generated config, stepped ticks times
+static Simulation makeSimulation(int plans, int options, int ticks)
+{
+    const string path = writeConfig(plans, options);
+    Simulation simulation(path);
+    remove(path.c_str());
+    if (ticks > 0)
+    {
+        simulation.step(ticks);
+    }
+    return simulation;
+}
+
+//The catalog a generated config loads into
+static FacilityCatalog makeCatalog(int options)
+{
+    const ScenarioGenerator generator(makeSettings(0, options));
+    FacilityCatalog catalog;
+    catalog.reserve(options);
+    for (int i = 0; i < options; ++i)
+    {
+        catalog.add(generator.makeFacility(i));
+    }
+    return catalog;
+}
+
+//One tick, starting over from the loaded simulation every 64 ticks so the plans stay young
+static void benchmarkStep(BenchmarkState &state, int plans, int options)
+{
+    state.pause();
+    const Simulation loaded = makeSimulation(plans, options, 0);
+    Simulation simulation = loaded;
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        if (i % 64 == 0 && i > 0)
+        {
+            state.pause();
+            simulation = loaded;
+            state.resume();
+        }
+        simulation.step();
+    }
+}
+
+static void benchmarkSelect(BenchmarkState &state, const SelectionPolicy &start, int options)
+{
+    state.pause();
+    const FacilityCatalog catalog = makeCatalog(options);
+    SelectionPolicy policy = start;
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        policy.selectFacility(catalog);
+    }
+}
+
+static void benchmarkSelectBuiltIn(BenchmarkState &state, const char *name, int options)
+{
+    SelectionPolicy policy;
+    SelectionPolicy::create(name, 0, 0, 0, policy);
+    benchmarkSelect(state, policy, options);
+}
+
+static void benchmarkSelectNaive(BenchmarkState &state, int, int options)
+{
+    benchmarkSelectBuiltIn(state, "nve", options);
+}
+
+static void benchmarkSelectBalanced(BenchmarkState &state, int, int options)
+{
+    benchmarkSelectBuiltIn(state, "bal", options);
+}
+
+static void benchmarkSelectEconomy(BenchmarkState &state, int, int options)
+{
+    benchmarkSelectBuiltIn(state, "eco", options);
+}
+
+static void benchmarkSelectSustainability(BenchmarkState &state, int, int options)
+{
+    benchmarkSelectBuiltIn(state, "env", options);
+}
+
+static void benchmarkSelectWeighted(BenchmarkState &state, int, int options)
+{
+    benchmarkSelect(state, WeightedSelection(make_shared<const WeightedPolicy>("weighted", "2*eco + env - price/2")), options);
+}
+
+//Loading the whole config into a simulation
+static void benchmarkConfig(BenchmarkState &state, int plans, int options)
+{
+    state.pause();
+    const string path = writeConfig(plans, options);
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        Simulation simulation(path);
+    }
+    state.pause();
+    remove(path.c_str());
+    state.resume();
+}
+
+//A backup of a simulation that changed since the last one
+static void benchmarkBackup(BenchmarkState &state, int plans, int options)
+{
+    state.pause();
+    Simulation simulation = makeSimulation(plans, options, 100);
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        state.pause();
+        simulation.step();
+        state.resume();
+        BackupSimulation("bench").act(simulation);
+    }
+    state.pause();
+    backups.clear();
+    state.resume();
+}
+
+//A restore followed by the tick that makes the restored simulation copy what it changes
+static void benchmarkRestore(BenchmarkState &state, int plans, int options)
+{
+    state.pause();
+    Simulation simulation = makeSimulation(plans, options, 100);
+    BackupSimulation("bench").act(simulation);
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        RestoreSimulation("bench").act(simulation);
+        simulation.step();
+    }
+    state.pause();
+    backups.clear();
+    undoJournal.clear();
+    state.resume();
+}
+
+//The status of one plan after 100 ticks
+static void benchmarkPlanStatus(BenchmarkState &state, int plans, int options)
+{
+    state.pause();
+    Simulation simulation = makeSimulation(plans, options, 100);
+    const Plan &plan = simulation.getPlan(0);
+    string text;
+    state.resume();
+    for (long long i = 0; i < state.getIterations(); ++i)
+    {
+        text.clear();
+        TextWriter out(text);
+        plan.render(out, simulation.getFacilityOptions());
+    }
+}
+
+static vector<Benchmark> listBenchmarks()
+{
+    vector<Benchmark> benchmarks;
+    for (int plans : {10, 1000})
+    {
+        for (int options : {12, 10000})
+        {
+            benchmarks.push_back({"step/plans:" + to_string(plans) + "/options:" + to_string(options), benchmarkStep, plans, options});
+        }
+    }
+    for (int options : {12, 10000})
+    {
+        const string size = "/options:" + to_string(options);
+        benchmarks.push_back({"select/nve" + size, benchmarkSelectNaive, 0, options});
+        benchmarks.push_back({"select/bal" + size, benchmarkSelectBalanced, 0, options});
+        benchmarks.push_back({"select/eco" + size, benchmarkSelectEconomy, 0, options});
+        benchmarks.push_back({"select/env" + size, benchmarkSelectSustainability, 0, options});
+        benchmarks.push_back({"select/weighted" + size, benchmarkSelectWeighted, 0, options});
+    }
+    benchmarks.push_back({"config/plans:1000/options:10000", benchmarkConfig, 1000, 10000});
+    benchmarks.push_back({"backup/plans:1000/options:1000", benchmarkBackup, 1000, 1000});
+    benchmarks.push_back({"restore/plans:1000/options:1000", benchmarkRestore, 1000, 1000});
+    benchmarks.push_back({"status/plans:10/options:12", benchmarkPlanStatus, 10, 12});
+    return benchmarks;
+}
+
+//Runs a benchmark with more and more iterations until a run lasts minSeconds
+static BenchmarkState measure(const Benchmark &benchmark, double minSeconds)
+{
+    long long iterations = 1;
+    while (true)
+    {
+        BenchmarkState state(iterations);
+        state.resume();
+        benchmark.run(state, benchmark.plans, benchmark.options);
+        state.pause();
+        const double seconds = state.getSeconds();
+        if (seconds >= minSeconds || iterations >= 1000000000)
+        {
+            return state;
+        }
+        //Aim a little past the minimum, growing at most a hundredfold per run
+        const double wanted = seconds > 0 ? iterations * minSeconds * 1.4 / seconds : iterations * 100.0;
+        iterations = max(iterations + 1, min(iterations * 100, static_cast<long long>(wanted)));
+    }
+}
+
+//The ns_per_op of each benchmark in a file this program wrote
+static map<string, double> readBaseline(const string &path)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        throw runtime_error("Could not open baseline file: " + path);
+    }
+    stringstream contents;
+    contents << file.rdbuf();
+    const string text = contents.str();
+    map<string, double> baseline;
+    const string nameKey = "\"name\": \"";
+    const string timeKey = "\"ns_per_op\": ";
+    for (size_t position = text.find(nameKey); position != string::npos; position = text.find(nameKey, position))
+    {
+        position += nameKey.size();
+        const size_t nameEnd = text.find('"', position);
+        const size_t time = text.find(timeKey, nameEnd);
+        if (nameEnd == string::npos || time == string::npos)
+        {
+            break;
+        }
+        baseline[text.substr(position, nameEnd - position)] = strtod(text.c_str() + time + timeKey.size(), nullptr);
+        position = time;
+    }
+    return baseline;
+}
+
+static void usage()
+{
+    cout << "usage: bench [--baseline <file>] [--filter <text>] [--min-time <ms>] [--tolerance <percent>]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    string baselinePath;
+    string filter;
+    double minSeconds = 0.2;
+    double tolerance = -1; //Percent; negative never fails
+    for (int i = 1; i < argc; ++i)
+    {
+        const string option = argv[i];
+        if (option == "--baseline" && i + 1 < argc)
+        {
+            baselinePath = argv[++i];
+        }
+        else if (option == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (option == "--min-time" && i + 1 < argc)
+        {
+            minSeconds = stod(argv[++i]) / 1000;
+        }
+        else if (option == "--tolerance" && i + 1 < argc)
+        {
+            tolerance = stod(argv[++i]);
+        }
+        else
+        {
+            usage();
+            return 0;
+        }
+    }
+
+    try
+    {
+        const map<string, double> baseline = baselinePath.empty() ? map<string, double>() : readBaseline(baselinePath);
+        bool regressed = false;
+        bool first = true;
+        cout << "{\n  \"benchmarks\": [";
+        for (const Benchmark &benchmark : listBenchmarks())
+        {
+            if (benchmark.name.find(filter) == string::npos)
+            {
+                continue;
+            }
+            const BenchmarkState result = measure(benchmark, minSeconds);
+            const double nanoseconds = result.getSeconds() * 1e9 / result.getIterations();
+            cout << (first ? "\n" : ",\n") << "    {\"name\": \"" << benchmark.name << "\", \"iterations\": " << result.getIterations()
+                 << ", \"ns_per_op\": " << nanoseconds << ", \"allocs_per_op\": " << static_cast<double>(result.getAllocations()) / result.getIterations();
+            const auto before = baseline.find(benchmark.name);
+            if (before != baseline.end() && before->second > 0)
+            {
+                const double change = (nanoseconds / before->second - 1) * 100;
+                cout << ", \"baseline_ns_per_op\": " << before->second << ", \"change_percent\": " << change;
+                regressed = regressed || (tolerance >= 0 && change > tolerance);
+            }
+            cout << '}' << flush;
+            first = false;
+        }
+        cout << "\n  ]\n}" << endl;
+        return regressed ? 1 : 0;
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,341 @@
+#include "Auxiliary.h"
+#include "ConstructionTable.h"
+#include "FacilityCatalog.h"
+#include "SelectionPolicy.h"
+#include "WeightedPolicy.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Checks that the fast paths of selection pick what the plain code they stand in for picks, run by
+// "make check":
+//     check [--rounds <count>]
+// - every balance scan the processor runs finds the type the scalar scan finds, and so does a
+//   scan by hand on long long sums, also for scores far past int
+// - one selectFacilities call for count picks gives the picks of count selectFacility calls, for
+//   every kind of policy, and leaves the policy in the same state
+// - a weighted policy, which only scores the types added since its last pick, picks the type a
+//   scan of the whole catalog with the weights written out by hand picks
+// The catalogs are random, with scores from small ranges so that ties are common, and grow between
+// picks. The first disagreement is printed and fails the run.
+
+//splitmix64, so every run checks the same cases
+class Random
+{
+    public:
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        uint64_t next()
+        {
+            uint64_t value = (state += 0x9e3779b97f4a7c15ULL);
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+            return value ^ (value >> 31);
+        }
+
+        //From low to high, both included
+        int between(int low, int high)
+        {
+            return static_cast<int>(between(static_cast<long long>(low), static_cast<long long>(high)));
+        }
+
+        long long between(long long low, long long high)
+        {
+            return low + static_cast<long long>(next() % static_cast<uint64_t>(high - low + 1));
+        }
+
+    private:
+        uint64_t state;
+};
+
+static void addTypes(Random &random, FacilityCatalog &catalog, int count, int scoreRange)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        catalog.add(FacilityType("f" + to_string(catalog.size()), static_cast<FacilityCategory>(random.between(0, 2)), random.between(0, scoreRange),
+            random.between(0, scoreRange), random.between(0, scoreRange), random.between(0, scoreRange)));
+    }
+}
+
+static int positionOf(const FacilityCatalog &catalog, const FacilityType &type)
+{
+    return static_cast<int>(&type - catalog.getTypes().data());
+}
+
+//The smallest max - min of the three sums, the first on a tie
+static int findBalancedByHand(const FacilityCatalog &catalog, long long lifeQuality, long long economy, long long environment)
+{
+    int best = 0;
+    long long bestBalance = 0;
+    for (int position = 0; position < catalog.size(); ++position)
+    {
+        const FacilityType &type = catalog[position];
+        const long long sums[3] = {type.getLifeQualityScore() + lifeQuality, type.getEconomyScore() + economy, type.getEnvironmentScore() + environment};
+        const long long balance = max({sums[0], sums[1], sums[2]}) - min({sums[0], sums[1], sums[2]});
+        if (position == 0 || balance < bestBalance)
+        {
+            best = position;
+            bestBalance = balance;
+        }
+    }
+    return best;
+}
+
+//Catalogs of every length up to a few vectors past the widest lanes, and now and then a long one.
+//Every other query has scores up to 2^40 apart, as plans gather over long steps
+static long long checkBalanceScans(Random &random, int rounds)
+{
+    static const int SCORE_RANGES[] = {2, 20, 100000, 2000000000}; //The last too wide for int lanes
+    vector<FacilityCatalog::BalanceScan> scans;
+    for (FacilityCatalog::BalanceScan scan : {FacilityCatalog::BalanceScan::SCALAR, FacilityCatalog::BalanceScan::SSE41, FacilityCatalog::BalanceScan::AVX2})
+    {
+        if (FacilityCatalog::canRun(scan))
+        {
+            scans.push_back(scan);
+        }
+    }
+    long long compared = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        const int scoreRange = SCORE_RANGES[round % 4];
+        FacilityCatalog catalog;
+        addTypes(random, catalog, round % 100 == 99 ? random.between(1000, 5000) : random.between(1, 40), scoreRange);
+        for (int query = 0; query < 8; ++query)
+        {
+            const long long range = query % 2 == 0 ? 2LL * scoreRange : 1LL << 40;
+            const long long lifeQuality = random.between(-range, range);
+            const long long economy = random.between(-range, range);
+            const long long environment = random.between(-range, range);
+            const int expected = findBalancedByHand(catalog, lifeQuality, economy, environment);
+            for (FacilityCatalog::BalanceScan scan : scans)
+            {
+                const int found = catalog.findMostBalanced(scan, lifeQuality, economy, environment);
+                if (found != expected)
+                {
+                    throw runtime_error(string("the ") + FacilityCatalog::getName(scan) + " balance scan found " + to_string(found) + " instead of "
+                        + to_string(expected) + " in a catalog of " + to_string(catalog.size()) + ", for scores " + to_string(lifeQuality) + " "
+                        + to_string(economy) + " " + to_string(environment));
+                }
+            }
+            if (catalog.findMostBalanced(lifeQuality, economy, environment) != expected)
+            {
+                throw runtime_error("findMostBalanced does not agree with the scan by hand");
+            }
+            compared++;
+        }
+    }
+    cout << "balance scans (by hand";
+    for (FacilityCatalog::BalanceScan scan : scans)
+    {
+        cout << ", " << FacilityCatalog::getName(scan);
+    }
+    cout << "): " << compared << " scans agree" << endl;
+    return compared;
+}
+
+static vector<SelectionPolicy> makePolicies(Random &random)
+{
+    vector<SelectionPolicy> policies;
+    for (const char *name : {"nve", "bal", "eco", "env"})
+    {
+        SelectionPolicy policy;
+        SelectionPolicy::create(name, random.between(0, 10), random.between(0, 10), random.between(0, 10), policy);
+        policies.push_back(policy);
+    }
+    policies.push_back(WeightedSelection(make_shared<const WeightedPolicy>("green", "2*eco + env - price/2")));
+    policies.push_back(WeightedSelection(make_shared<const WeightedPolicy>("parks", "life - eco only 0 2")));
+    return policies;
+}
+
+//Both copies of a policy pick side by side from the same catalog, which grows now and then
+static long long checkBatchSelection(Random &random, int rounds)
+{
+    long long compared = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        FacilityCatalog catalog;
+        addTypes(random, catalog, random.between(1, 12), 5);
+        for (const SelectionPolicy &start : makePolicies(random))
+        {
+            SelectionPolicy batch = start;
+            SelectionPolicy single = start;
+            for (int step = 0; step < 40; ++step)
+            {
+                if (random.between(0, 3) == 0)
+                {
+                    addTypes(random, catalog, random.between(1, 3), 5);
+                }
+                const int count = random.between(1, MAX_CONSTRUCTION_LIMIT);
+                int batchPositions[MAX_CONSTRUCTION_LIMIT];
+                int singlePositions[MAX_CONSTRUCTION_LIMIT];
+                bool batchFailed = false;
+                bool singleFailed = false;
+                try
+                {
+                    batch.selectFacilities(catalog, count, batchPositions);
+                }
+                catch (const runtime_error &)
+                {
+                    batchFailed = true;
+                }
+                try
+                {
+                    for (int i = 0; i < count; ++i)
+                    {
+                        singlePositions[i] = positionOf(catalog, single.selectFacility(catalog));
+                    }
+                }
+                catch (const runtime_error &)
+                {
+                    singleFailed = true;
+                }
+                if (batchFailed != singleFailed)
+                {
+                    throw runtime_error(start.toString() + ": " + (batchFailed ? "only the batch call" : "only the single calls") + " failed");
+                }
+                if (batchFailed)
+                {
+                    break; //a failed pick may leave either copy part of the way
+                }
+                for (int i = 0; i < count; ++i)
+                {
+                    if (batchPositions[i] != singlePositions[i])
+                    {
+                        throw runtime_error(start.toString() + ": pick " + to_string(i + 1) + " of " + to_string(count) + " was " + to_string(batchPositions[i])
+                            + " in one call and " + to_string(singlePositions[i]) + " one at a time");
+                    }
+                }
+                vector<long long> batchKey, singleKey;
+                batch.appendCycleKey(batchKey);
+                single.appendCycleKey(singleKey);
+                batch.appendRunningTotals(batchKey);
+                single.appendRunningTotals(singleKey);
+                if (batchKey != singleKey)
+                {
+                    throw runtime_error(start.toString() + ": the state after one call differs from the state after single calls");
+                }
+                compared++;
+            }
+        }
+    }
+    cout << "batch selection: " << compared << " batches agree with single picks" << endl;
+    return compared;
+}
+
+// A weighted policy and the weights its definition comes to, up to a positive factor
+struct WeightedCase
+{
+    const char *definition;
+    long long weights[FacilityCatalog::SCORE_COLUMNS];
+    bool allowed[3];
+};
+
+//The highest weighted sum among the allowed types, the first on a tie; -1 if there is none
+static int findBestByHand(const FacilityCatalog &catalog, const WeightedCase &weighted)
+{
+    int best = -1;
+    long long bestSum = 0;
+    for (int position = 0; position < catalog.size(); ++position)
+    {
+        const FacilityType &type = catalog[position];
+        if (!weighted.allowed[static_cast<int>(type.getCategory())])
+        {
+            continue;
+        }
+        const long long sum = weighted.weights[0] * type.getLifeQualityScore() + weighted.weights[1] * type.getEconomyScore()
+            + weighted.weights[2] * type.getEnvironmentScore() + weighted.weights[3] * type.getCost();
+        if (best < 0 || sum > bestSum)
+        {
+            best = position;
+            bestSum = sum;
+        }
+    }
+    return best;
+}
+
+static long long checkWeightedPolicies(Random &random, int rounds)
+{
+    static const WeightedCase CASES[] = {
+        {"2*eco + env - price/2", {0, 4, 2, -1}, {true, true, true}},
+        {"life - eco only 0 2", {1, -1, 0, 0}, {true, false, true}},
+        {"env/3 + price/2 only eco", {0, 0, 2, 3}, {false, true, false}},
+        {"3*life + 2*eco - 5*env - price only life env", {3, 2, -5, -1}, {true, false, true}},
+    };
+    long long compared = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (const WeightedCase &weighted : CASES)
+        {
+            FacilityCatalog catalog;
+            addTypes(random, catalog, random.between(0, 6), 8);
+            SelectionPolicy policy = WeightedSelection(make_shared<const WeightedPolicy>("weighted", weighted.definition));
+            for (int step = 0; step < 30; ++step)
+            {
+                if (random.between(0, 2) == 0)
+                {
+                    addTypes(random, catalog, random.between(1, 4), 8);
+                }
+                const int expected = findBestByHand(catalog, weighted);
+                int found = -1;
+                try
+                {
+                    policy.selectFacilities(catalog, 1, &found);
+                }
+                catch (const runtime_error &)
+                {
+                    found = -1;
+                }
+                if (found != expected)
+                {
+                    throw runtime_error(string("policy \"") + weighted.definition + "\" picked " + to_string(found) + " instead of " + to_string(expected)
+                        + " in a catalog of " + to_string(catalog.size()));
+                }
+                compared++;
+            }
+        }
+    }
+    cout << "weighted policies: " << compared << " picks agree with a full scan" << endl;
+    return compared;
+}
+
+static void usage()
+{
+    cout << "usage: check [--rounds <count>]" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 2000;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string option = argv[i];
+        if (option == "--rounds" && i + 1 < argc && Auxiliary::parseInteger(argv[i + 1], rounds) && rounds >= 1)
+        {
+            ++i;
+        }
+        else
+        {
+            usage();
+            return 0;
+        }
+    }
+
+    try
+    {
+        Random random(1);
+        checkBalanceScans(random, rounds * 10);
+        checkBatchSelection(random, rounds);
+        checkWeightedPolicies(random, rounds);
+        return 0;
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << endl;
+        return 1;
+    }
+}
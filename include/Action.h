@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include "Simulation.h"
+#include "ActionLog.h"
 enum class SettlementType;
 enum class FacilityCategory;
 
@@ -14,7 +15,10 @@ class BaseAction{
         BaseAction();
         ActionStatus getStatus() const;
         virtual void act(Simulation& simulation)=0;
-        virtual const string toString() const=0;
+        //The action's line in the log
+        const string toString() const;
+        //Stores the action in the log as a record; the text is only made when the log is printed
+        virtual void appendTo(ActionLog &log) const=0;
         virtual BaseAction* clone() const = 0;
         virtual ~BaseAction() = default;
 
@@ -23,6 +27,11 @@ class BaseAction{
         void error(string errorMsg);
         const string &getErrorMsg() const;
         string statusToString() const;
+        //A record of this action's opcode and status, for appendTo to add the arguments to
+        LogRecord makeRecord(ActionLog &log, LogOpcode opcode) const;
+        //Called first by actions that change the simulation, so undo can bring it back; replacing
+        //when the action replaces the whole simulation
+        void recordUndo(Simulation &simulation, bool replacing = false);
 
     private:
         string errorMsg;
@@ -34,7 +43,7 @@ class SimulateStep : public BaseAction {
     public:
         SimulateStep(const int numOfSteps);
         void act(Simulation &simulation) override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
         SimulateStep *clone() const override;
     private:
         const int numOfSteps;
@@ -44,7 +53,7 @@ class AddPlan : public BaseAction {
     public:
         AddPlan(const string &settlementName, const string &selectionPolicy);
         void act(Simulation &simulation) override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
         AddPlan *clone() const override;
     private:
         const string settlementName;
@@ -57,7 +66,7 @@ class AddSettlement : public BaseAction {
         AddSettlement(const string &settlementName,SettlementType settlementType);
         void act(Simulation &simulation) override;
         AddSettlement *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
         const string settlementName;
         const SettlementType settlementType;
@@ -70,7 +79,7 @@ class AddFacility : public BaseAction {
         AddFacility(const string &facilityName, const FacilityCategory facilityCategory, const int price, const int lifeQualityScore, const int economyScore, const int environmentScore);
         void act(Simulation &simulation) override;
         AddFacility *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
         const string facilityName;
         const FacilityCategory facilityCategory;
@@ -86,7 +95,7 @@ class PrintPlanStatus: public BaseAction {
         PrintPlanStatus(int planId);
         void act(Simulation &simulation) override;
         PrintPlanStatus *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
         const int planId;
 };
@@ -97,19 +106,32 @@ class ChangePlanPolicy : public BaseAction {
         ChangePlanPolicy(const int planId, const string &newPolicy);
         void act(Simulation &simulation) override;
         ChangePlanPolicy *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
         const int planId;
         const string newPolicy;
 };
 
 
+//Adds a weighted selection policy, see WeightedPolicy.h
+class DefinePolicy : public BaseAction {
+    public:
+        DefinePolicy(const string &policyName, const string &definition);
+        void act(Simulation &simulation) override;
+        DefinePolicy *clone() const override;
+        void appendTo(ActionLog &log) const override;
+    private:
+        const string policyName;
+        const string definition;
+};
+
+
 class PrintActionsLog : public BaseAction {
     public:
         PrintActionsLog();
         void act(Simulation &simulation) override;
         PrintActionsLog *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
 };
 
@@ -118,25 +140,63 @@ class Close : public BaseAction {
         Close();
         void act(Simulation &simulation) override;
         Close *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
 };
 
+//Checkpoints are named; a plain backup/restore uses the unnamed one
 class BackupSimulation : public BaseAction {
     public:
-        BackupSimulation();
+        BackupSimulation(const string &checkpointName);
         void act(Simulation &simulation) override;
         BackupSimulation *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
+        const string checkpointName;
 };
 
 
 class RestoreSimulation : public BaseAction {
     public:
-        RestoreSimulation();
+        RestoreSimulation(const string &checkpointName);
         void act(Simulation &simulation) override;
         RestoreSimulation *clone() const override;
-        const string toString() const override;
+        void appendTo(ActionLog &log) const override;
     private:
-};
\ No newline at end of file
+        const string checkpointName;
+};
+
+
+//Rolls back the last numOfActions actions that could change the simulation: steps, additions,
+//policy changes and restores, failed ones included
+class UndoActions : public BaseAction {
+    public:
+        UndoActions(const int numOfActions);
+        void act(Simulation &simulation) override;
+        UndoActions *clone() const override;
+        void appendTo(ActionLog &log) const override;
+    private:
+        const int numOfActions;
+};
+
+
+class SaveSimulation : public BaseAction {
+    public:
+        SaveSimulation(const string &filePath);
+        void act(Simulation &simulation) override;
+        SaveSimulation *clone() const override;
+        void appendTo(ActionLog &log) const override;
+    private:
+        const string filePath;
+};
+
+
+class LoadSimulation : public BaseAction {
+    public:
+        LoadSimulation(const string &filePath);
+        void act(Simulation &simulation) override;
+        LoadSimulation *clone() const override;
+        void appendTo(ActionLog &log) const override;
+    private:
+        const string filePath;
+};
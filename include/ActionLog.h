@@ -0,0 +1,89 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "CopyOnWrite.h"
+#include "NameIndex.h"
+#include "TextWriter.h"
+using std::string;
+
+//One per kind of action; LINE is a log line read back from a snapshot
+enum class LogOpcode : uint8_t
+{
+    STEP,
+    PLAN,
+    SETTLEMENT,
+    FACILITY,
+    PLAN_STATUS,
+    CHANGE_POLICY,
+    PRINT_LOG,
+    CLOSE,
+    BACKUP,
+    RESTORE,
+    UNDO,
+    SAVE,
+    LOAD,
+    POLICY,
+    LINE,
+};
+
+// One logged action in 32 bytes. Strings (names, policies, paths, the error message) are ids
+// in the log's string pool. An opcode's string arguments come before its numbers.
+struct LogRecord
+{
+    LogOpcode opcode;
+    bool failed;
+    int32_t errorMsg; //String id, only set when failed
+    int32_t args[6];
+};
+
+// The actions log. Records are appended to chunks that copies of a simulation share, and
+// are only turned into text when the log is printed or saved. With a limit set, the oldest
+// entries are written out as text to a spill file and read back from it when printed.
+// Copies share the spill file, each keeping its own list of the segments it wrote or inherited.
+class ActionLog
+{
+    public:
+        ActionLog();
+        int intern(std::string_view text);
+        void append(const LogRecord &record);
+        void appendLine(std::string_view line);
+        //Entries in memory and spilled
+        int size() const;
+        //Drops every entry, keeping the limit and spill file
+        void clear();
+        //A copy without the string index, so that interning into this log does not copy the index;
+        //rebuildIndex must run before the copy interns anything
+        ActionLog withoutIndex() const;
+        void rebuildIndex();
+        //Keeps at most limit entries in memory; older ones go to spillPath, or a temporary file if empty
+        void setLimit(int limit, const string &spillPath);
+        //Calls visit with the text of every entry, oldest first
+        void forEachLine(const std::function<void(std::string_view)> &visit) const;
+        void print(TextWriter &out) const;
+
+    private:
+        struct Segment
+        {
+            long long offset;
+            long long length;
+        };
+
+        class SpillFile;
+
+        string format(const LogRecord &record) const;
+        void render(TextWriter &out, const LogRecord &record) const;
+        void spill();
+        static int stringArgumentCount(LogOpcode opcode);
+        static int internInto(ChunkedVector<string> &strings, NameIndex &index, std::string_view text);
+
+        ChunkedVector<LogRecord> records;
+        ChunkedVector<string> strings;
+        NameIndex stringIndex;
+        ChunkedVector<Segment> segments;
+        int spilledCount;
+        int limit; //0 keeps everything in memory
+        std::shared_ptr<SpillFile> spillFile;
+};
@@ -3,8 +3,17 @@
 #include <vector>
 #include <sstream>
 #include <string>
+#include <string_view>
 
 class Auxiliary{
     public:
         static std::vector<std::string> parseArguments(const std::string& line);
+        //Splits line on whitespace without allocating; fills at most capacity views and returns the argument count
+        static int splitArguments(std::string_view line, std::string_view *arguments, int capacity);
+        //The text of line from argument (a view into it) to its end, less trailing whitespace
+        static std::string_view restOfLine(std::string_view line, std::string_view argument);
+        //Reads the integer text starts with, as stoi does; false if there is none or it does not fit
+        static bool parseInteger(std::string_view text, int &value);
+        //Settlement types and facility categories both run from 0 to 2, in the config file and in commands alike
+        static bool isTypeCode(int value);
 };
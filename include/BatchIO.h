@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+using std::vector;
+
+// Reads commands from a file descriptor in large blocks and hands them out a line at a time.
+// A line is a view into the block, valid until the next call to nextLine.
+class CommandReader
+{
+    public:
+        explicit CommandReader(int fd);
+        //False once the input is exhausted; a last line without a line break is still returned
+        bool nextLine(std::string_view &line);
+
+    private:
+        bool fill();
+
+        int fd;
+        vector<char> buffer;
+        size_t begin;
+        size_t end;
+        bool finished;
+};
+
+// Stands in for cout's buffer in batch mode. Output collects in one large block that is
+// written out when it fills and on flush, which only the flush command and the end of the
+// batch ask for; the handlers themselves no longer flush.
+class BatchOutput : public std::streambuf
+{
+    public:
+        explicit BatchOutput(int fd);
+        BatchOutput(const BatchOutput &other) = delete;
+        BatchOutput &operator=(const BatchOutput &other) = delete;
+        ~BatchOutput();
+
+    protected:
+        int_type overflow(int_type ch) override;
+        int sync() override;
+
+    private:
+        bool drain();
+
+        int fd;
+        vector<char> buffer;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ThreadPool.h"
+using std::string;
+using std::vector;
+
+// One settlement, facility, policy or plan line of a configuration file. Names are views into the
+// mapped file, so an entry is only valid while the ConfigFile it came from is alive.
+struct ConfigEntry
+{
+    enum Kind
+    {
+        SETTLEMENT,
+        FACILITY,
+        PLAN,
+        POLICY,
+    };
+
+    Kind kind;
+    int line;
+    std::string_view name; //Settlement, facility or policy name; for a plan, the settlement it builds in
+    std::string_view policy; //Plan: its policy's name. Policy: the rest of the line, its definition
+    int values[5]; //Settlement: type. Facility: category, price, life quality, economy, environment
+};
+
+// Read-only mapping of a configuration file. Large files are cut into chunks at line breaks
+// and the chunks are tokenized on the thread pool; entries still come back in file order,
+// and the error reported is always the one on the earliest bad line.
+class ConfigFile
+{
+    public:
+        explicit ConfigFile(const string &path);
+        ConfigFile(const ConfigFile &other) = delete;
+        ConfigFile &operator=(const ConfigFile &other) = delete;
+        ~ConfigFile();
+        //pool may be null to parse on the calling thread
+        vector<ConfigEntry> parse(ThreadPool *pool) const;
+        [[noreturn]] void fail(int line, const string &reason) const;
+
+    private:
+        enum LineResult
+        {
+            PARSED,
+            SKIPPED,
+            MALFORMED,
+        };
+
+        struct Chunk
+        {
+            size_t begin;
+            size_t end;
+            int lineCount;
+            vector<ConfigEntry> entries;
+            int errorLine; //0 if the chunk parsed cleanly
+            string error;
+        };
+
+        void parseChunk(Chunk &chunk) const;
+        static LineResult parseLine(std::string_view line, ConfigEntry &entry, string &error);
+
+        string path;
+        const char *data;
+        size_t size;
+};
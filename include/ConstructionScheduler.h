@@ -0,0 +1,56 @@
+#pragma once
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "ConstructionTable.h"
+#include "CopyOnWrite.h"
+#include "Snapshot.h"
+using std::vector;
+
+// Decides which ticks have any work. Plans that just became AVALIABLE wait in the ready
+// list to fill their slots on the next tick; every construction row adds a completion
+// event for the tick it finishes on. Ticks with neither are skipped entirely. A plan that
+// skipped whole cycles sleeps until a wake-up event puts it back in the ready list.
+// Copies share the ready list and both event heaps until one of them changes it.
+class ConstructionScheduler {
+    private:
+        typedef std::pair<long long, int> Event;
+        typedef std::priority_queue<Event, vector<Event>, std::greater<Event>> EventQueue;
+
+    public:
+        //What undo keeps to put the scheduler back. Completions are left out: every construction
+        //row has its completion event pending, so restore rebuilds them from the table
+        struct UndoState {
+            CowPtr<vector<int>> readyPlans;
+            CowPtr<EventQueue> wakeups;
+        };
+
+        ConstructionScheduler();
+        void markReady(int planId);
+        bool hasReady() const;
+        //Moves the ready plans into planIds, in plan id order
+        void takeReady(vector<int> &planIds);
+        void scheduleCompletion(long long tick, int planId);
+        bool hasCompletions() const;
+        long long getNextCompletionTick() const;
+        //Pops the next event on or before tick; false once there is none
+        bool popCompletion(long long tick, int &planId);
+        //Puts the plan in the ready list of the given tick, so it fills its slots on that tick
+        void scheduleWakeup(long long tick, int planId);
+        bool hasWakeups() const;
+        long long getNextWakeupTick() const;
+        bool popWakeup(long long tick, int &planId);
+        UndoState getUndoState() const;
+        void restore(const UndoState &state, const ConstructionTable &constructions);
+        void save(SnapshotWriter &writer) const;
+        void load(SnapshotReader &reader, int planCount);
+
+    private:
+        static void saveEvents(SnapshotWriter &writer, EventQueue events);
+        static void loadEvents(SnapshotReader &reader, int planCount, EventQueue &events);
+
+        CowPtr<vector<int>> readyPlans;
+        CowPtr<EventQueue> completions;
+        CowPtr<EventQueue> wakeups;
+};
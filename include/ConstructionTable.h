@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include "Facility.h"
+#include "Snapshot.h"
+using std::vector;
+
+//A metropolis builds three facilities at once; no settlement type allows more
+const int MAX_CONSTRUCTION_LIMIT = 3;
+
+// Every facility under construction, across all plans, stored column by column.
+// A row records the tick its facility becomes operational, so nothing is counted down:
+// the scheduler wakes the owning plan on that tick and only the finished rows are
+// turned into Facility records.
+class ConstructionTable {
+    public:
+        //Everything stored for one construction, as undo keeps it
+        struct Row {
+            long long finishTick;
+            int planId;
+            int facilityIndex;
+            int lifeQualityDelta;
+            int economyDelta;
+            int environmentDelta;
+        };
+
+        ConstructionTable();
+        int add(int planId, int facilityIndex, const FacilityType &facilityType, long long startTick);
+        int size() const;
+        bool isCompleted(int row, long long tick) const;
+        int getPlanId(int row) const;
+        int getFacilityIndex(int row) const;
+        long long getFinishTick(int row) const;
+        int getTimeLeft(int row, long long tick) const;
+        int getLifeQualityDelta(int row) const;
+        int getEconomyDelta(int row) const;
+        int getEnvironmentDelta(int row) const;
+        void delay(int row, long long ticks);
+        //Fills the hole with the last row; returns the plan owning the moved row, -1 if none moved
+        int remove(int row);
+        Row getRow(int row) const;
+        void setRow(int row, const Row &values);
+        //Drops the rows from count on, or adds blank ones up to count
+        void resize(int count);
+        void save(SnapshotWriter &writer) const;
+        //Appends the saved rows, checking them against the number of plans and facility options
+        void load(SnapshotReader &reader, int planCount, int facilityCount);
+
+    private:
+        vector<long long> finishTick;
+        vector<int> planId;
+        vector<int> facilityIndex;
+        vector<int> lifeQualityDelta;
+        vector<int> economyDelta;
+        vector<int> environmentDelta;
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+// Value shared by every copy until one of them writes to it; the writer then gets its own.
+// Copying a simulation for a backup copies these handles, not the state behind them.
+template <typename T>
+class CowPtr {
+    public:
+        CowPtr() : value(std::make_shared<T>()) {}
+
+        const T &read() const { return *value; }
+        const T &operator*() const { return *value; }
+        const T *operator->() const { return value.get(); }
+
+        T &write()
+        {
+            if (value.use_count() > 1) {
+                value = std::make_shared<T>(*value);
+            }
+            return *value;
+        }
+
+    private:
+        std::shared_ptr<T> value;
+};
+
+// Vector stored in fixed-size chunks that copies share. Full chunks are listed in a directory
+// the copies share as well, so a copy costs two pointers however long the vector is. Appending
+// to or changing an element of a copy clones only the chunk it lands in, plus the directory
+// once the chunk is full.
+template <typename T, int ChunkSize = 64>
+class ChunkedVector {
+    public:
+        ChunkedVector() : full(), tail(), count(0) {}
+
+        int size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T &operator[](int index) const { return (*chunkAt(index))[index % ChunkSize]; }
+        const T &back() const { return (*this)[count - 1]; }
+
+        T &write(int index)
+        {
+            std::shared_ptr<Chunk> &chunk = index / ChunkSize < static_cast<int>(full->size()) ? full.write()[index / ChunkSize] : tail;
+            unshare(chunk);
+            return (*chunk)[index % ChunkSize];
+        }
+
+        void push_back(T item)
+        {
+            if (!tail) {
+                tail = std::make_shared<Chunk>();
+                tail->reserve(ChunkSize);
+            } else {
+                unshare(tail);
+            }
+            tail->push_back(std::move(item));
+            ++count;
+            if (tail->size() == ChunkSize) {
+                full.write().push_back(std::move(tail));
+                tail.reset();
+            }
+        }
+
+        //The vector must not be empty
+        void pop_back()
+        {
+            if (!tail) {
+                tail = full->back();
+                full.write().pop_back();
+            }
+            unshare(tail);
+            tail->pop_back();
+            --count;
+            if (tail->empty()) {
+                tail.reset();
+            }
+        }
+
+    private:
+        typedef std::vector<T> Chunk;
+
+        const std::shared_ptr<Chunk> &chunkAt(int index) const
+        {
+            return index / ChunkSize < static_cast<int>(full->size()) ? (*full)[index / ChunkSize] : tail;
+        }
+
+        static void unshare(std::shared_ptr<Chunk> &chunk)
+        {
+            if (chunk.use_count() > 1) {
+                std::shared_ptr<Chunk> copy = std::make_shared<Chunk>();
+                copy->reserve(ChunkSize);
+                copy->insert(copy->end(), chunk->begin(), chunk->end());
+                chunk = copy;
+            }
+        }
+
+        CowPtr<std::vector<std::shared_ptr<Chunk>>> full;
+        std::shared_ptr<Chunk> tail; //The last chunk while it is not yet full; null otherwise
+        int count;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+using std::vector;
+
+// Remembers the state a plan had on each tick it filled its slots during one long step.
+// Selection and construction are deterministic, so once a state comes back the plan repeats
+// the same period until the step ends, and whole periods can be applied at once.
+class CycleDetector {
+    public:
+        //What a plan had gathered when the state was seen; the difference between two marks is one period
+        struct Mark {
+            long long tick;
+            int facilityRecords;
+            long long lifeQualityScore;
+            long long economyScore;
+            long long environmentScore;
+            vector<long long> policyTotals;
+        };
+
+        CycleDetector();
+        //Returns the earlier mark recorded under key, or records mark and returns nullptr
+        const Mark *findOrRecord(const vector<long long> &key, const Mark &mark);
+        bool isActive() const;
+        void stop();
+
+    private:
+        //Plans that do not repeat within this many fills are left to run tick by tick
+        static const size_t MAX_MARKS = 4096;
+
+        struct KeyHash {
+            size_t operator()(const vector<long long> &key) const;
+        };
+
+        std::unordered_map<vector<long long>, Mark, KeyHash> marks;
+        bool active;
+};
@@ -1,10 +1,16 @@
 #pragma once
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
+#include "CopyOnWrite.h"
+#include "TextWriter.h"
 using std::string;
 using std::vector;
 
-enum class FacilityStatus
+class Settlement;
+
+enum class FacilityStatus : unsigned char
 {
     UNDER_CONSTRUCTIONS,
     OPERATIONAL,
@@ -39,22 +45,29 @@ class FacilityType {
 };
 
 
-class Facility : public FacilityType
+// Flyweight record of a built facility. Name, category, price and scores live once in the
+// simulation's facility options and the settlement name once in its settlement list;
+// a record only keeps the two indices plus its own construction state.
+class Facility
 {
 
 public:
-    Facility(const string &name, const string &settlementName, const FacilityCategory category, const int price, const int lifeQuality_score, const int economy_score, const int environment_score);
-    Facility(const FacilityType &type, const string &settlementName);
-    const string &getSettlementName() const;
+    Facility(const int facilityId, const int settlementId, const int timeLeft);
+    int getFacilityId() const;
+    int getSettlementId() const;
+    const FacilityType &getType(const vector<FacilityType> &facilityOptions) const;
+    const string &getName(const vector<FacilityType> &facilityOptions) const;
+    const string &getSettlementName(const ChunkedVector<std::shared_ptr<Settlement>> &settlements) const;
     const int getTimeLeft() const;
     FacilityStatus step();
     void setStatus(FacilityStatus status);
     const FacilityStatus &getStatus() const;
-    const string toString() const;
-    Facility *clone() const;
+    const string toString(const vector<FacilityType> &facilityOptions, const ChunkedVector<std::shared_ptr<Settlement>> &settlements) const;
+    void render(TextWriter &out, const vector<FacilityType> &facilityOptions, const ChunkedVector<std::shared_ptr<Settlement>> &settlements) const;
 
 private:
-    const string settlementName;
-    FacilityStatus status;
+    uint32_t facilityId;
+    uint32_t settlementId;
     int timeLeft;
+    FacilityStatus status;
 };
\ No newline at end of file
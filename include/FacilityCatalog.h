@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include "Facility.h"
+using std::vector;
+
+// The facility options, in the order they were added. Next to the FacilityType list each score
+// is kept in a column of its own, so scans that only compare scores read contiguous ints instead
+// of walking the types through their getters, and each category lists the positions of its types.
+class FacilityCatalog
+{
+    public:
+        //Columns findHighestWeighted weighs: life quality, economy, environment and price, in that order
+        static const int SCORE_COLUMNS = 4;
+        //Versions of the scan behind findMostBalanced, narrowest first. It uses the widest one the
+        //processor runs; all of them give the same answer
+        enum class BalanceScan
+        {
+            SCALAR,
+            SSE41,
+            AVX2,
+        };
+        static bool canRun(BalanceScan scan);
+        static const char *getName(BalanceScan scan);
+
+        FacilityCatalog();
+        void add(FacilityType type);
+        void reserve(int count);
+        //Drops the types from position count on
+        void truncate(int count);
+        int size() const;
+        bool empty() const;
+        const FacilityType &operator[](int index) const;
+        const vector<FacilityType> &getTypes() const;
+        //Positions of the types in category, in increasing order
+        const vector<int> &getPositions(FacilityCategory category) const;
+        //Position of the type that leaves the three scores closest together once added to them,
+        //the first one on a tie. The catalog must not be empty
+        int findMostBalanced(long long lifeQualityScore, long long economyScore, long long environmentScore) const;
+        //The same with the given scan, which the processor must run
+        int findMostBalanced(BalanceScan scan, long long lifeQualityScore, long long economyScore, long long environmentScore) const;
+        //Position of the type with the highest weighted sum of its score columns among best (-1 for
+        //none) and the types from position first on whose category is allowed, the lowest on a tie;
+        //-1 if there is none
+        int findHighestWeighted(const long long *weights, const bool *allowed, int first, int best) const;
+
+    private:
+        vector<FacilityType> types;
+        vector<int> lifeQualityScores;
+        vector<int> economyScores;
+        vector<int> environmentScores;
+        vector<int> prices;
+        vector<int> categoryPositions[3]; //Indexed by FacilityCategory
+        int lowestScore, highestScore; //Over the three score columns
+};
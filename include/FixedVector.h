@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+
+// Vector with its storage inline and a compile-time capacity.
+// Used where the size is known to be tiny, e.g. a plan's construction slots.
+template <typename T, int Capacity>
+class FixedVector {
+    public:
+        FixedVector() : count(0), items() {}
+
+        int size() const { return count; }
+        bool empty() const { return count == 0; }
+        bool full() const { return count == Capacity; }
+        void clear() { count = 0; }
+
+        void push_back(const T &item) { items[count++] = item; }
+        void pop_back() { count--; }
+
+        T &back() { return items[count - 1]; }
+        const T &back() const { return items[count - 1]; }
+        T &operator[](int index) { return items[index]; }
+        const T &operator[](int index) const { return items[index]; }
+
+        T *begin() { return items; }
+        T *end() { return items + count; }
+        const T *begin() const { return items; }
+        const T *end() const { return items + count; }
+
+    private:
+        int count;
+        T items[Capacity];
+};
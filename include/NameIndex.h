@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "CopyOnWrite.h"
+using std::vector;
+
+// Hash index from names to positions in an append-only list (settlements, facility options).
+// Open addressing over (hash, position) pairs; the names themselves stay in the list.
+// Copies of a simulation share the table until one of them adds or drops a name (see CopyOnWrite.h).
+// Two names may hash alike, so a hit only counts once the caller's list confirms the name.
+class NameIndex {
+    public:
+        NameIndex();
+        //position must be the next free one in the caller's list
+        void add(std::string_view name, int position);
+        //Drops the names at size and past it, as the caller's list is cut back to size
+        void truncate(int size);
+
+        //nameAt(position) gives the name stored at a position in the caller's list; returns -1 if absent
+        template <typename NameAt>
+        int find(std::string_view name, const NameAt &nameAt) const
+        {
+            const vector<Slot> &slots = table->slots;
+            const uint64_t hash = hashName(name);
+            for (size_t i = hash & (slots.size() - 1); slots[i].position != EMPTY; i = (i + 1) & (slots.size() - 1)) {
+                const Slot &slot = slots[i];
+                if (slot.hash == hash && nameAt(slot.position) == name) {
+                    return slot.position;
+                }
+            }
+            return -1;
+        }
+
+    private:
+        static const int EMPTY = -1;
+
+        struct Slot {
+            uint64_t hash;
+            int position;
+        };
+        struct Table {
+            vector<Slot> slots; //power of two, at most half full
+            size_t used;
+        };
+
+        static uint64_t hashName(std::string_view name);
+        static void insert(vector<Slot> &slots, const Slot &slot);
+
+        CowPtr<Table> table;
+};
@@ -1,10 +1,24 @@
 #pragma once
+#include <memory>
 #include <vector>
 #include "Facility.h"
+#include "FacilityCatalog.h"
 #include "Settlement.h"
 #include "SelectionPolicy.h"
+#include "ConstructionTable.h"
+#include "CopyOnWrite.h"
+#include "FixedVector.h"
+#include "CycleDetector.h"
+#include "TextWriter.h"
 using std::vector;
 
+//facilities[first, last) listed repeat times in a row
+struct FacilityRun {
+    int first;
+    int last;
+    long long repeat;
+};
+
 enum class PlanStatus {
     AVALIABLE,
     BUSY,
@@ -12,33 +26,71 @@ enum class PlanStatus {
 
 class Plan {
     public:
-        Plan(const int planId, const Settlement &settlement, SelectionPolicy *selectionPolicy, const vector<FacilityType> &facilityOptions);
+        //What a plan's actions and steps change, as undo keeps it. Facility records and runs are only
+        //ever added, so their counts and the last run are enough to cut them back
+        struct UndoState {
+            SelectionPolicy selectionPolicy;
+            PlanStatus status;
+            int facilityRecords;
+            int facilityRunCount;
+            FacilityRun lastRun;
+            long long facilityCount;
+            FixedVector<int, MAX_CONSTRUCTION_LIMIT> underConstruction;
+            FixedVector<int, MAX_CONSTRUCTION_LIMIT> selected;
+            long long lifeQualityScore, economyScore, environmentScore;
+        };
+
+        Plan(const int planId, const Settlement &settlement, const int settlementId, const SelectionPolicy &selectionPolicy);
         Plan(const Plan &other);
-        Plan(Plan &&other);
-        ~Plan();    
+        Plan(Plan &&other) noexcept;
+        ~Plan() = default;
         Plan& operator=(const Plan &other) = delete;
         Plan& operator=(Plan &&other) = delete;
-        const int getlifeQualityScore() const;
-        const int getEconomyScore() const;
-        const int getEnvironmentScore() const;
-        const SelectionPolicy *getSelectionPolicy() const;
-        void setSelectionPolicy(SelectionPolicy *selectionPolicy);
-        void step();
-        void printStatus();
-        const vector<Facility*> &getFacilities() const;
-        void addFacility(Facility* facility);
-        const string toString() const;
+        const long long getlifeQualityScore() const;
+        const long long getEconomyScore() const;
+        const long long getEnvironmentScore() const;
+        const int getPlanId() const;
+        PlanStatus getPlanStatus() const;
+        const Settlement &getSettlement() const;
+        const SelectionPolicy &getSelectionPolicy() const;
+        void setSelectionPolicy(const SelectionPolicy &selectionPolicy);
+        //Picks facilities for the free slots; returns how many
+        int selectFacilities(const FacilityCatalog &facilityOptions);
+        //False when selectFacilities would throw for lack of anything to pick
+        bool canSelect(const FacilityCatalog &facilityOptions) const;
+        void step(ConstructionTable &constructions, const vector<FacilityType> &facilityOptions, long long tick);
+        void collectCompleted(const ConstructionTable &constructions, long long tick, FixedVector<int, MAX_CONSTRUCTION_LIMIT> &finishedRows);
+        void relocateConstruction(int fromRow, int toRow);
+        void printStatus(const vector<FacilityType> &facilityOptions) const;
+        const ChunkedVector<Facility> &getFacilities() const;
+        const vector<FacilityRun> &getFacilityRuns() const;
+        long long getFacilityCount() const;
+        void addFacility(const Facility &facility);
+        const FixedVector<int, MAX_CONSTRUCTION_LIMIT> &getUnderConstruction() const;
+        bool getCycleKey(const ConstructionTable &constructions, long long tick, vector<long long> &key) const;
+        CycleDetector::Mark getCycleMark(long long tick) const;
+        bool skipCycles(const CycleDetector::Mark &start, long long tick, long long periods, ConstructionTable &constructions);
+        UndoState getUndoState() const;
+        void restore(const UndoState &state);
+        void save(SnapshotWriter &writer) const;
+        static std::shared_ptr<Plan> load(SnapshotReader &reader, const ChunkedVector<std::shared_ptr<Settlement>> &settlements, const FacilityCatalog &facilityOptions, const vector<std::shared_ptr<const WeightedPolicy>> &policyDefinitions, const ConstructionTable &constructions);
+        const string toString(const vector<FacilityType> &facilityOptions) const;
+        //Writes what toString returns straight to out
+        void render(TextWriter &out, const vector<FacilityType> &facilityOptions) const;
         void setPlanStatus();
-         
+
 
     private:
         int plan_id;
         const Settlement &settlement;
-        SelectionPolicy *selectionPolicy; //What happens if we change this to a reference?
+        int settlementId; //index of the settlement in the simulation, stored by every Facility record
+        SelectionPolicy selectionPolicy; //Held inline, see SelectionPolicy.h
         PlanStatus status;
-        vector<Facility*> facilities;
-        vector<Facility*> underConstruction;
-        const vector<FacilityType> &facilityOptions;
-        int life_quality_score, economy_score, environment_score;
+        ChunkedVector<Facility> facilities; //one record per facility built tick by tick, shared with copies
+        vector<FacilityRun> facilityRuns; //the order facilities are listed in; skipped cycles repeat a run
+        long long facilityCount;
+        FixedVector<int, MAX_CONSTRUCTION_LIMIT> underConstruction; //rows in the simulation's ConstructionTable
+        FixedVector<int, MAX_CONSTRUCTION_LIMIT> selected; //picked by selectFacilities, not yet in the table
+        long long life_quality_score, economy_score, environment_score; //Long steps take them past int
         int constructionLimit;
-};
\ No newline at end of file
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include "Facility.h"
+#include "TextWriter.h"
+
+// What a generated scenario looks like. The mixes are relative weights: settlementMix is indexed
+// by SettlementType, categoryMix by FacilityCategory and policyMix lists nve, bal, eco and env.
+struct ScenarioSettings
+{
+    uint64_t seed = 1;
+    int settlements = 3;
+    int facilities = 12;
+    int plans = 2;
+    int settlementMix[3] = {1, 1, 1};
+    int categoryMix[3] = {1, 1, 1};
+    int policyMix[4] = {1, 1, 1, 1};
+    //The script: steps step commands of minTicks to maxTicks ticks each, and before each of them
+    //another action (a status, policy change, new facility or new settlement with a plan) with
+    //actionPercent percent chance
+    int steps = 0;
+    int minTicks = 1;
+    int maxTicks = 1;
+    int actionPercent = 0;
+};
+
+// Writes configs and command scripts in the grammar the simulation reads, for load tests far
+// larger than config_file.txt. Everything follows from the settings: the same seed gives the
+// same files on every machine. Settlements are s0, s1..., facilities f0, f1... with prices 1-5
+// and scores 0-5, and plan i is on settlement i modulo the settlement count.
+class ScenarioGenerator
+{
+    public:
+        //Throws runtime_error if the settings are out of range
+        explicit ScenarioGenerator(const ScenarioSettings &settings);
+        void writeConfig(TextWriter &out) const;
+        //Commands for the simulation writeConfig describes, ending with close
+        void writeScript(TextWriter &out) const;
+        //Facility index of the config
+        FacilityType makeFacility(int index) const;
+
+    private:
+        //A random number for item index of one kind of item; the same arguments give the same number
+        uint64_t random(uint64_t kind, uint64_t index) const;
+
+        ScenarioSettings settings;
+};
@@ -1,67 +1,143 @@
 #pragma once
+#include <memory>
+#include <string_view>
+#include <variant>
 #include <vector>
 #include "Facility.h"
+#include "FacilityCatalog.h"
+#include "Snapshot.h"
+#include "WeightedPolicy.h"
 using std::vector;
 
-class SelectionPolicy
+// What a policy does unless it says otherwise. The policies below are plain classes with the same
+// methods; they hide these with their own versions, and SelectionPolicy calls whichever the
+// concrete class has, so nothing here is virtual
+class PolicyDefaults
 {
 public:
-    virtual const FacilityType &selectFacility(const vector<FacilityType> &facilitiesOptions) = 0;
-    virtual const string toString() const = 0;
-    virtual SelectionPolicy *clone() const = 0;
-    virtual ~SelectionPolicy() = default;
+    //False when selectFacilities is bound to throw for these options
+    bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+    //Cycle detection: running totals are state that only grows; two policies with the same
+    //cycle key differ in nothing else
+    void appendRunningTotals(vector<long long> &totals) const;
+    void addRunningTotals(const vector<long long> &delta, long long times);
 };
 
-class NaiveSelection : public SelectionPolicy
+class NaiveSelection : public PolicyDefaults
 {
 public:
-    NaiveSelection();
-    const FacilityType &selectFacility(const vector<FacilityType> &facilitiesOptions) override;
-    const string toString() const override;
-    NaiveSelection *clone() const override;
-    ~NaiveSelection() override = default;
+    explicit NaiveSelection(int lastSelectedIndex = 0);
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const string toString() const;
+    void appendCycleKey(vector<long long> &key) const;
+    void save(SnapshotWriter &writer) const;
 
 private:
     int lastSelectedIndex;
 };
 
-class BalancedSelection : public SelectionPolicy
+class BalancedSelection : public PolicyDefaults
 {
 public:
-    BalancedSelection(int LifeQualityScore, int EconomyScore, int EnvironmentScore);
-    const FacilityType &selectFacility(const vector<FacilityType> &facilitiesOptions) override;
-    const string toString() const override;
-    BalancedSelection *clone() const override;
-    ~BalancedSelection() override = default;
+    BalancedSelection(long long LifeQualityScore, long long EconomyScore, long long EnvironmentScore);
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const string toString() const;
+    void appendCycleKey(vector<long long> &key) const;
+    void appendRunningTotals(vector<long long> &totals) const;
+    void addRunningTotals(const vector<long long> &delta, long long times);
+    void save(SnapshotWriter &writer) const;
 
 private:
-    int LifeQualityScore;
-    int EconomyScore;
-    int EnvironmentScore;
+    long long LifeQualityScore;
+    long long EconomyScore;
+    long long EnvironmentScore;
 };
 
-class EconomySelection : public SelectionPolicy
+class EconomySelection : public PolicyDefaults
 {
 public:
-    EconomySelection();
-    const FacilityType &selectFacility(const vector<FacilityType> &facilitiesOptions) override;
-    const string toString() const override;
-    EconomySelection *clone() const override;
-    ~EconomySelection() override = default;
+    explicit EconomySelection(int lastSelectedIndex = 0);
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const string toString() const;
+    bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+    void appendCycleKey(vector<long long> &key) const;
+    void save(SnapshotWriter &writer) const;
 
 private:
     int lastSelectedIndex;
+    int cursor; //Where the next pick is in the catalog's economy positions; a hint, -1 when unknown
 };
 
-class SustainabilitySelection : public SelectionPolicy
+class SustainabilitySelection : public PolicyDefaults
 {
 public:
-    SustainabilitySelection();
-    const FacilityType &selectFacility(const vector<FacilityType> &facilitiesOptions) override;
-    const string toString() const override;
-    SustainabilitySelection *clone() const override;
-    ~SustainabilitySelection() override = default;
+    explicit SustainabilitySelection(int lastSelectedIndex = 0);
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const string toString() const;
+    bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+    void appendCycleKey(vector<long long> &key) const;
+    void save(SnapshotWriter &writer) const;
 
 private:
     int lastSelectedIndex;
-};
\ No newline at end of file
+    int cursor; //Where the next pick is in the catalog's environment positions; a hint, -1 when unknown
+};
+
+// Follows a WeightedPolicy. Its pick only changes when facilities are added, so the best position
+// is kept and only the options added since the last pick are scored
+class WeightedSelection : public PolicyDefaults
+{
+public:
+    explicit WeightedSelection(std::shared_ptr<const WeightedPolicy> definition);
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const string toString() const;
+    bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+    void appendCycleKey(vector<long long> &key) const;
+    void save(SnapshotWriter &writer) const;
+
+private:
+    std::shared_ptr<const WeightedPolicy> definition; //Shared with the simulation's policy list
+    int scanned; //Options already scored
+    int best; //The best of them, -1 for none
+};
+
+// A plan's selection policy, held by value. The policy is one alternative of a variant, so a plan
+// keeps it inline, copying a plan copies it without allocating, and every call is dispatched by
+// std::visit straight to the concrete policy instead of through a vtable.
+class SelectionPolicy
+{
+public:
+    typedef std::variant<NaiveSelection, BalancedSelection, EconomySelection, SustainabilitySelection, WeightedSelection> Alternatives;
+    static const int KINDS = std::variant_size_v<Alternatives>;
+
+    //Naive, from the first option
+    SelectionPolicy();
+    SelectionPolicy(const NaiveSelection &policy);
+    SelectionPolicy(const BalancedSelection &policy);
+    SelectionPolicy(const EconomySelection &policy);
+    SelectionPolicy(const SustainabilitySelection &policy);
+    SelectionPolicy(const WeightedSelection &policy);
+    //The built-in policy called name (nve, bal, eco or env) with fresh state, bal starting from the
+    //given scores. False for any other name
+    static bool create(std::string_view name, long long lifeQualityScore, long long economyScore, long long environmentScore, SelectionPolicy &created);
+
+    //Fills positions with the catalog positions of the next count picks, the ones count calls to
+    //selectFacility would return
+    void selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions);
+    const FacilityType &selectFacility(const FacilityCatalog &facilitiesOptions);
+    const string toString() const;
+    //Which of the alternatives this is, from 0 to KINDS - 1, and its name: nve, bal, eco, env or weighted
+    int getKind() const;
+    static const char *getKindName(int kind);
+    bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+    void appendCycleKey(vector<long long> &key) const;
+    void appendRunningTotals(vector<long long> &totals) const;
+    void addRunningTotals(const vector<long long> &delta, long long times);
+    //Writes the policy kind and its state; load reads it back
+    void save(SnapshotWriter &writer) const;
+    //A weighted policy is looked up by name in definitions
+    static SelectionPolicy load(SnapshotReader &reader, const FacilityCatalog &facilitiesOptions, const vector<std::shared_ptr<const WeightedPolicy>> &definitions);
+
+private:
+    Alternatives policy;
+};
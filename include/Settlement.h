@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include "TextWriter.h"
 using std::string;
 using std::vector;
 
@@ -21,6 +22,7 @@ public:
     SettlementType getType() const;
     string settlementTypeToString(SettlementType type) const;
     const string toString() const;
+    void render(TextWriter &out) const;
 
 private:
     const string name;
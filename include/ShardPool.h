@@ -0,0 +1,140 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+using std::string;
+using std::vector;
+
+class TextWriter;
+struct SharedRing; //Lives in the shared memory segment, see ShardPool.cpp
+
+enum class ShardMessage : uint8_t
+{
+    COMMAND, //A line for the worker to run
+    QUIET_COMMAND, //A line to run without printing anything
+    QUIT, //No more commands
+    OUTPUT, //Text the worker printed
+    SECTION, //Ends the text of one plan printed by close
+    DONE, //The command finished; "closed" if it was close
+    STEP, //How the worker's step went, a ShardFailure
+    DECISION, //The failure every worker is to report
+};
+
+// How a step ended on one shard, or for all of them: the tick it failed on (-1 for none), the
+// plan whose selection failed and the error a single process would have reported
+struct ShardFailure
+{
+    long long tick;
+    int planId;
+    string message;
+};
+
+// Messages going one way between two processes, through a byte ring in shared memory. Either
+// side sleeps on the ring's process-shared condition variable while the ring is empty or full,
+// and gives up with a runtime_error once the process at the other end is gone.
+class ShardRing
+{
+    public:
+        ShardRing(SharedRing *shared, pid_t peer);
+        void send(ShardMessage kind, std::string_view payload);
+        ShardMessage receive(string &payload);
+
+    private:
+        void write(const char *data, size_t size);
+        void read(char *data, size_t size);
+
+        SharedRing *shared;
+        pid_t peer;
+};
+
+// Stands in for cout's buffer in a worker, passing what it prints to the coordinator unless muted
+class ShardOutput : public std::streambuf
+{
+    public:
+        explicit ShardOutput(ShardRing &replies);
+        ShardOutput(const ShardOutput &other) = delete;
+        ShardOutput &operator=(const ShardOutput &other) = delete;
+        void setMuted(bool muted);
+
+    protected:
+        int_type overflow(int_type ch) override;
+        int sync() override;
+
+    private:
+        ShardRing &replies;
+        vector<char> buffer;
+        bool muted;
+};
+
+// A worker's end of its rings, held by the simulation it runs (see Simulation::startShard)
+class ShardLink
+{
+    public:
+        ShardLink(SharedRing *commands, SharedRing *replies, pid_t coordinator, int shard, int shardCount);
+        ShardLink(const ShardLink &other) = delete;
+        ShardLink &operator=(const ShardLink &other) = delete;
+        //Plans are dealt out round robin by id
+        bool ownsPlan(int planId) const { return planId % shardCount == shard; }
+        std::streambuf *getOutput();
+        //False once the coordinator has no more commands
+        bool nextCommand(string &line);
+        void endCommand(bool closed);
+        //Ends the text of one plan; close prints every plan the shard owns as a section of its own
+        void endSection();
+        //Tells the coordinator how this shard's step went and returns the failure every shard reports
+        ShardFailure agreeOnFailure(const ShardFailure &failure);
+
+    private:
+        string expect(ShardMessage kind);
+
+        ShardRing commands;
+        ShardRing replies;
+        ShardOutput output;
+        int shard;
+        int shardCount;
+};
+
+// Runs one simulation as several processes. The coordinator forks a worker per shard once the
+// config is loaded, so every worker starts out sharing the catalog, settlements and plans with it
+// page by page instead of reading them again. Each worker then runs every command on its own copy
+// of the simulation but only steps the plans it owns; the coordinator reads the commands, hands
+// them to the workers through one pair of rings each and prints what the worker owning the plan a
+// command is about (worker 0 for the rest) prints, the others running it quietly. For close every
+// worker prints its own plans, which the coordinator reads from them in turn to keep them in order.
+class ShardPool
+{
+    public:
+        explicit ShardPool(int shardCount);
+        ShardPool(const ShardPool &other) = delete;
+        ShardPool &operator=(const ShardPool &other) = delete;
+        //The coordinator stops its workers and waits for them
+        ~ShardPool();
+        //Forks the workers; returns the shard a worker is to run, or -1 in the coordinator
+        int spawn();
+        std::shared_ptr<ShardLink> getLink(int shard);
+        //Read commands as Simulation::start and startBatch do
+        void start();
+        void startBatch(const string &scriptPath);
+
+    private:
+        SharedRing *commandRing(int shard) const;
+        SharedRing *replyRing(int shard) const;
+        void runCommand(std::string_view line);
+        //Writes out what the worker prints up to the end of the command, a step or a section, and
+        //returns which of them it reached; payload holds the message that ended it
+        ShardMessage readReply(int shard, TextWriter &out, string &payload);
+
+        int shardCount;
+        int self; //The shard this process runs, -1 in the coordinator
+        pid_t coordinator;
+        SharedRing *rings; //A command ring and a reply ring per shard
+        size_t mappedBytes;
+        vector<pid_t> workers;
+        vector<ShardRing> commands;
+        vector<ShardRing> replies;
+        bool running; //Until the simulation is closed
+};
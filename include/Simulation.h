@@ -1,41 +1,116 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "Facility.h"
+#include "FacilityCatalog.h"
 #include "Plan.h"
+#include "SelectionPolicy.h"
 #include "Settlement.h"
+#include "ConstructionTable.h"
+#include "ConstructionScheduler.h"
+#include "CycleDetector.h"
+#include "NameIndex.h"
+#include "ActionLog.h"
+#include "CopyOnWrite.h"
+#include "SimulationStats.h"
+#include "ThreadPool.h"
+#include "ShardPool.h"
+#include "Trace.h"
+#include "UndoRecord.h"
 using std::string;
 using std::vector;
 
 class BaseAction;
-class SelectionPolicy;
 
 class Simulation {
     public:
-        Simulation(const string &configFilePath);
+        Simulation(const string &configFilePath, int threadCount = 1);
+        Simulation(const Simulation &other) = default;
+        Simulation &operator=(const Simulation &other) = default;
         void start();
-        void addPlan(const Settlement &settlement, SelectionPolicy *selectionPolicy);
+        //Non-interactive start: reads the script (stdin if empty) in blocks and buffers all output
+        void startBatch(const string &scriptPath);
+        //Runs the commands the coordinator sends as one shard of a sharded simulation; see ShardPool.h
+        void startShard(const std::shared_ptr<ShardLink> &link);
+        void addPlan(const Settlement &settlement, const SelectionPolicy &selectionPolicy);
         void addAction(BaseAction *action);
         bool addSettlement(Settlement *settlement);
         bool addFacility(FacilityType facility);
         bool isSettlementExists(const string &settlementName);
         Settlement &getSettlement(const string &settlementName);
         Plan &getPlan(const int planID);
+        //Reads the plan without unsharing it from copies of this simulation
+        const Plan &getPlan(const int planID) const;
+        const vector<FacilityType> &getFacilityOptions() const;
         //Helper Method to get the actions log
-        vector<BaseAction *> getActionsLog() const;
+        const ActionLog &getActionsLog() const;
         //Helper Method to get planCounter
         int getPlanCounter() const;
-        //helper method to get the selection policy
-        SelectionPolicy* createSelectionPolicy(const string &policyName);
+        //Adds a weighted policy plans can then be given by name (see WeightedPolicy.h); throws runtime_error
+        //if the name is taken or the definition is invalid
+        void definePolicy(const string &policyName, const string &definition);
+        //helper method to get the selection policy: false for an unknown name; bal starts from the given scores
+        bool createSelectionPolicy(const string &policyName, SelectionPolicy &policy, long long lifeQualityScore = 0, long long economyScore = 0, long long environmentScore = 0) const;
         void step();
+        void step(int numOfSteps);
+        //Threads used by step; 1 keeps everything on the calling thread
+        void setThreadCount(int threadCount);
+        //Keeps at most limit log entries in memory, spilling older ones to spillPath (a temporary file if empty)
+        void setLogLimit(int limit, const string &spillPath);
+        //Starts or stops collecting what the stats command prints
+        void setStatsEnabled(bool enabled);
+        //Records spans from now on, written to path on close; see Trace.h
+        void startTracing(const string &path);
         void close();
         void open();
+        void saveSnapshot(const string &path) const;
+        void loadSnapshot(const string &path);
+        //Keeps what changes from now on in record, until the next record starts; with replacing set
+        //the next action replaces the whole simulation, and record keeps a copy of it instead
+        void startUndoRecord(const std::shared_ptr<UndoRecord> &record, bool replacing);
+        //Puts the simulation back as it was when record started. Later records must be undone first
+        void undo(const UndoRecord &record);
 
     private:
+        void runCommand(std::string_view line);
+        void runStatsCommand(std::string_view option);
+        void runTraceCommand(const std::string_view *arguments, int count);
+        Plan &writePlan(int planId);
+        int getSettlementId(const Settlement &settlement) const;
+        int findSettlement(std::string_view settlementName) const;
+        int findFacility(std::string_view facilityName) const;
+        void runTicks(long long lastTick, int stopPlan);
+        void runTick(long long tick, long long lastTick, int stopPlan);
+        void stepShard(long long lastTick);
+        bool ownsPlan(int planId) const;
+        void startCycleDetection(long long numOfSteps);
+        void skipCycles(long long tick, long long lastTick);
+        void selectFacilities(const vector<int> &planIds);
+
         bool isRunning;
         int planCounter; //For assigning unique plan IDs
-        vector<BaseAction*> actionsLog;
-        vector<Plan> plans;
-        vector<Settlement*> settlements;
-        vector<FacilityType> facilitiesOptions;
-};
\ No newline at end of file
+        long long currentTick; //Ticks simulated so far
+        //Everything below up to the scratch lists is shared with copies of this simulation (backups)
+        //until one side changes it; see CopyOnWrite.h
+        ActionLog actionsLog;
+        ChunkedVector<std::shared_ptr<Plan>> plans; //Each plan is copied on its first change as well
+        ChunkedVector<std::shared_ptr<Settlement>> settlements;
+        CowPtr<FacilityCatalog> facilitiesOptions;
+        CowPtr<vector<std::shared_ptr<const WeightedPolicy>>> policyDefinitions; //In the order they were defined
+        NameIndex settlementIndex; //Settlement names to ids
+        NameIndex facilityIndex; //Facility names to positions in facilitiesOptions
+        CowPtr<ConstructionTable> constructions; //Facilities under construction, for every plan
+        ConstructionScheduler scheduler; //Ticks on which plans fill slots or constructions finish
+        vector<int> readyPlans; //Scratch list of the plans filling their slots on the current tick
+        vector<CycleDetector> cycleDetectors; //One per plan during a long step, empty otherwise
+        vector<long long> cycleKey; //Scratch
+        long long failedTick; //Where the last failing step stopped, and the plan that failed it
+        int failedPlan;
+        std::shared_ptr<ThreadPool> threadPool; //Null when stepping serially
+        std::shared_ptr<SimulationStats> stats; //Shared with copies
+        std::shared_ptr<TraceRecorder> trace; //Shared with copies
+        std::shared_ptr<ShardLink> shard; //Null unless this process runs one shard of the plans
+        UndoTarget undoTarget; //Where changes are kept for undo, see UndoRecord.h
+};
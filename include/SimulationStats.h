@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "SelectionPolicy.h"
+#include "TextWriter.h"
+using std::string;
+using std::vector;
+
+// Latencies in nanoseconds, bucketed HDR style: exact below 32, above that 32 buckets per power
+// of two, so any value is reported within about 3% of what was recorded
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram();
+        void record(long long nanoseconds);
+        long long getCount() const;
+        long long getMean() const;
+        long long getMax() const;
+        //The highest value in the bucket holding the given percentile of the recorded values
+        long long getPercentile(double percentile) const;
+
+    private:
+        static const int SUB_BUCKET_BITS = 5;
+        static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        //Values from 2^40 ns, about 18 minutes, on share the last bucket
+        static const int MAX_EXPONENT = 40;
+        static const int BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+        static int bucketOf(long long nanoseconds);
+        static long long highestIn(int bucket);
+
+        vector<long long> counts;
+        long long count;
+        long long sum;
+        long long max;
+};
+
+// Engine counters and command latencies, collected only while enabled. Counters are totals since
+// collecting began or was reset; the facility counters are also kept for the last step command.
+// A simulation shares its stats with its copies, so restoring a backup or undoing does not roll
+// them back.
+class SimulationStats
+{
+    public:
+        SimulationStats();
+        bool isEnabled() const { return enabled; }
+        void setEnabled(bool enabled);
+        //Forgets everything recorded, enabled or not
+        void reset();
+
+        //Ends a step command of the given ticks; what was recorded since the last one counts for it
+        void recordStep(long long ticks);
+        void recordFacilities(long long started, long long completed);
+        void recordSelection(int policyKind, long long calls, long long picks, long long nanoseconds);
+        void recordCommand(std::string_view command, long long nanoseconds);
+
+        //Plan statuses and the log size are the simulation's current ones, passed in when printing
+        void writeText(TextWriter &out, int busyPlans, int availablePlans, int logEntries) const;
+        void writeJson(TextWriter &out, int busyPlans, int availablePlans, int logEntries) const;
+
+    private:
+        struct Counts
+        {
+            long long ticks;
+            long long facilitiesStarted;
+            long long facilitiesCompleted;
+        };
+        struct Selection
+        {
+            long long calls;
+            long long picks;
+            long long nanoseconds;
+        };
+
+        bool enabled;
+        Counts totals;
+        Counts lastStep;
+        Counts totalsBeforeStep; //totals when the last step command ended
+        Selection selections[SelectionPolicy::KINDS]; //Indexed by SelectionPolicy::getKind
+        vector<std::pair<string, LatencyHistogram>> commands; //In the order first seen
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+using std::string;
+
+// Binary snapshot files: an 8-byte magic, a version and then each part of the simulation as
+// written by its own save method. Numbers are stored little-endian at their natural width,
+// strings as a 32-bit length followed by the bytes. Bump SNAPSHOT_VERSION on any change.
+const uint32_t SNAPSHOT_VERSION = 3;
+
+class SnapshotWriter {
+    public:
+        SnapshotWriter();
+        void writeU8(uint8_t value);
+        void writeI32(int32_t value);
+        void writeI64(int64_t value);
+        void writeString(const string &value);
+        //Writes everything to path, replacing the file
+        void writeTo(const string &path) const;
+
+    private:
+        void append(const void *bytes, size_t size);
+        void appendLittleEndian(uint64_t value, size_t size);
+
+        string buffer;
+};
+
+// Reads a snapshot straight out of a read-only mapping of the file. Every read is bounds
+// checked, and a file that ends early or fails a check throws runtime_error.
+class SnapshotReader {
+    public:
+        explicit SnapshotReader(const string &path);
+        SnapshotReader(const SnapshotReader &other) = delete;
+        SnapshotReader &operator=(const SnapshotReader &other) = delete;
+        ~SnapshotReader();
+        uint8_t readU8();
+        int32_t readI32();
+        int64_t readI64();
+        string readString();
+        //Reads a count that must be between 0 and limit and, at itemSize bytes per item, fit in the rest of the file
+        int readCount(int limit, size_t itemSize = 1);
+        bool atEnd() const;
+        [[noreturn]] void fail(const string &reason) const;
+
+    private:
+        void read(void *bytes, size_t size);
+        uint64_t readLittleEndian(size_t size);
+
+        string path;
+        const unsigned char *data;
+        size_t size;
+        size_t offset;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+class Simulation;
+
+// Variants of one loaded configuration, run side by side to compare their final scores. A sweep
+// file lists them, one per line, with # starting a comment:
+//     <ticks> [<policy>...]
+//         one variant stepping ticks ticks; a single policy is given to every plan, several go to
+//         the plans in order, and * (or no policy) keeps the policy a plan was configured with
+//     grid <ticks>[,<ticks>...] <policy>[,<policy>...]
+//         a variant for every tick count with every policy given to every plan
+// Each variant runs on a copy of the loaded simulation, so the catalog, settlements and plans are
+// shared read-only until a variant changes them, and the config is read once for all of them.
+class Sweep
+{
+    public:
+        //Throws runtime_error naming the first bad line
+        explicit Sweep(const string &path);
+        int size() const;
+        //Runs every variant, threadCount at a time, and prints one row per variant and plan, in the
+        //order of the file, then the throughput
+        void run(const Simulation &base, int threadCount) const;
+
+    private:
+        struct Variant
+        {
+            int ticks;
+            vector<string> policies; //Empty, one for every plan, or one per plan; * keeps a plan's own
+        };
+
+        void fail(int line, const string &reason) const;
+        //Fills rows with the variant's rows and returns true, or with the reason it failed and returns false
+        bool runVariant(const Simulation &base, int variantId, string &rows) const;
+
+        string path;
+        vector<Variant> variants;
+};
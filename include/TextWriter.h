@@ -0,0 +1,74 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <streambuf>
+#include <string>
+#include <string_view>
+using std::string;
+
+// Streaming formatter for everything the simulation prints. Text, and numbers through
+// std::to_chars, are copied into a fixed block that goes to the output in one piece when it
+// fills and when the writer is flushed or destroyed; no temporary strings are built.
+// A writer over a string appends to it instead, which is how the toString methods work.
+class TextWriter
+{
+    public:
+        explicit TextWriter(std::streambuf *output);
+        explicit TextWriter(string &output);
+        TextWriter(const TextWriter &other) = delete;
+        TextWriter &operator=(const TextWriter &other) = delete;
+        ~TextWriter();
+
+        TextWriter &operator<<(std::string_view text)
+        {
+            if (text.size() > BLOCK_BYTES - used)
+            {
+                flush();
+                if (text.size() > BLOCK_BYTES)
+                {
+                    writeOut(text.data(), text.size());
+                    return *this;
+                }
+            }
+            memcpy(block + used, text.data(), text.size());
+            used += text.size();
+            return *this;
+        }
+
+        TextWriter &operator<<(char c)
+        {
+            if (used == BLOCK_BYTES)
+            {
+                flush();
+            }
+            block[used++] = c;
+            return *this;
+        }
+
+        TextWriter &operator<<(long long value)
+        {
+            //20 characters hold any long long with its sign
+            if (BLOCK_BYTES - used < 20)
+            {
+                flush();
+            }
+            used = std::to_chars(block + used, block + BLOCK_BYTES, value).ptr - block;
+            return *this;
+        }
+
+        TextWriter &operator<<(int value) { return *this << static_cast<long long>(value); }
+
+        //Passes what the block holds on to the output
+        void flush();
+
+    private:
+        static const size_t BLOCK_BYTES = 16384;
+
+        void writeOut(const char *text, size_t size);
+
+        std::streambuf *stream;
+        string *target;
+        char block[BLOCK_BYTES];
+        size_t used;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using std::vector;
+
+// Fixed set of worker threads with one task deque each. A worker drains its own deque
+// from the back and steals from the front of the others once it runs dry, so uneven
+// chunks (a metropolis plan costs more than a village plan) still spread over all cores.
+// parallelFor blocks until every chunk ran; the calling thread takes part as worker 0.
+class ThreadPool {
+    public:
+        explicit ThreadPool(int threadCount);
+        ThreadPool(const ThreadPool &other) = delete;
+        ThreadPool &operator=(const ThreadPool &other) = delete;
+        ~ThreadPool();
+        int getThreadCount() const;
+        //body(begin, end) is called once per chunk of at most grain indices and must not throw
+        void parallelFor(int begin, int end, int grain, const std::function<void(int, int)> &body);
+
+    private:
+        struct Task {
+            int begin;
+            int end;
+        };
+
+        struct WorkQueue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        void workerLoop(int self);
+        void runTasks(int self);
+        bool takeTask(int self, Task &task);
+
+        vector<std::thread> threads;
+        vector<std::unique_ptr<WorkQueue>> queues;
+        const std::function<void(int, int)> *body;
+        std::atomic<int> pending;
+        std::mutex sleepLock;
+        std::condition_variable wake;
+        unsigned long generation;
+        bool stopping;
+};
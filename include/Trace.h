@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+using std::string;
+using std::vector;
+
+// One finished span. Names and details are string literals or views of them, never copies
+struct TraceEvent
+{
+    std::string_view name;
+    const char *detail; //Null for none
+    long long value; //A plan id, tick or tick count; -1 for none
+    long long start; //Nanoseconds since the recorder was made
+    long long duration;
+};
+
+// Spans recorded while tracing is on, written out as Chrome trace event JSON for a trace viewer.
+// Every thread appends to a buffer of its own without locking; a thread takes the lock once, to
+// register its buffer with the recorder. Buffers are only read by dump, which must not run while
+// other threads record: the simulation dumps between commands, when its workers are idle.
+class TraceRecorder
+{
+    public:
+        TraceRecorder();
+        TraceRecorder(const TraceRecorder &other) = delete;
+        TraceRecorder &operator=(const TraceRecorder &other) = delete;
+        ~TraceRecorder();
+
+        bool isEnabled() const { return enabled; }
+        void setEnabled(bool enabled);
+        //Where close writes the trace
+        const string &getPath() const;
+        void setPath(const string &path);
+        bool empty() const;
+        //Nanoseconds since the recorder was made
+        long long now() const;
+        //Adds a span from start to now on the calling thread's buffer
+        void record(std::string_view name, const char *detail, long long value, long long start);
+        //Writes every span recorded so far to path and forgets them; throws runtime_error if the
+        //file cannot be written
+        void dump(const string &path);
+
+    private:
+        //Spans kept per thread; later ones are counted and dropped
+        static const long long MAX_THREAD_EVENTS = 1 << 21;
+        static const int BLOCK_EVENTS = 4096;
+
+        struct ThreadBuffer
+        {
+            std::thread::id thread;
+            vector<std::unique_ptr<TraceEvent[]>> blocks;
+            long long count;
+            long long dropped;
+        };
+
+        ThreadBuffer &localBuffer();
+
+        const long long id; //Tells this recorder's buffers from an earlier one's at the same address
+        bool enabled;
+        string path;
+        std::chrono::steady_clock::time_point epoch;
+        std::mutex registration;
+        vector<std::unique_ptr<ThreadBuffer>> buffers; //In the order the threads first recorded
+};
+
+// Records the span from its construction to its destruction, if tracing was on when it started
+class TraceSpan
+{
+    public:
+        TraceSpan(TraceRecorder &recorder, std::string_view name, const char *detail = nullptr, long long value = -1)
+            : recorder(recorder.isEnabled() ? &recorder : nullptr), name(name), detail(detail), value(value), start(this->recorder ? recorder.now() : 0)
+        {
+        }
+        TraceSpan(const TraceSpan &other) = delete;
+        TraceSpan &operator=(const TraceSpan &other) = delete;
+        ~TraceSpan()
+        {
+            if (recorder != nullptr)
+            {
+                recorder->record(name, detail, value, start);
+            }
+        }
+
+    private:
+        TraceRecorder *recorder;
+        std::string_view name;
+        const char *detail;
+        long long value;
+        long long start;
+};
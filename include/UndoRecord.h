@@ -0,0 +1,64 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+#include "ActionLog.h"
+#include "ConstructionScheduler.h"
+#include "ConstructionTable.h"
+#include "Plan.h"
+using std::vector;
+
+class Simulation;
+
+// What one action changed, kept so that undo can take it back. Only the old version of what the
+// action touched is kept, so a record costs about as much as the change did:
+// - what each plan it changed had before its first change, see Plan::UndoState
+// - each construction row it overwrote or dropped, as it was before; rows it added are dropped
+// - how long the lists that only grow were: plans, settlements, facility options and policies
+// - the scheduler's ready list and wake-ups, and the actions log, which copies share until they
+//   change (see CopyOnWrite.h)
+// An action that replaces the whole simulation (restore, load) keeps the simulation it replaced
+// instead.
+class UndoRecord {
+    public:
+        UndoRecord();
+        //Keeps plan as it is before its first change; plans added by the action are left out
+        void keepPlan(int planId, const Plan &plan);
+        //Keeps row as it is before its first change; rows added by the action are left out
+        void keepRow(const ConstructionTable &constructions, int row);
+        //Frees what is only needed while the action runs
+        void finish();
+        //Roughly what the record holds on its own, for the journal's budget
+        size_t getBytes() const;
+
+        std::shared_ptr<const Simulation> previous; //Set by actions that replace everything; nothing below is used then
+        size_t previousBytes; //What previous holds, counted in full though backups may share some of it
+        int planCounter;
+        long long currentTick;
+        long long failedTick;
+        int failedPlan;
+        int settlementCount;
+        int facilityCount;
+        int policyCount;
+        int constructionCount;
+        ActionLog actionsLog; //Without its string index, see ActionLog::withoutIndex
+        ConstructionScheduler::UndoState scheduler;
+        vector<std::pair<int, Plan::UndoState>> plans;
+        vector<std::pair<int, ConstructionTable::Row>> rows;
+
+    private:
+        vector<bool> keptPlans; //Below planCounter, while the action runs
+        vector<bool> keptRows; //Below constructionCount, while the action runs
+};
+
+// The record a simulation writes its changes to, if any. It is not copied along: a copy of a
+// simulation (a backup, a sweep variant, the copy a shard takes before a step) records nothing,
+// and a simulation keeps its own record when another one is assigned to it.
+class UndoTarget {
+    public:
+        UndoTarget() : record() {}
+        UndoTarget(const UndoTarget &) : record() {}
+        UndoTarget &operator=(const UndoTarget &) { return *this; }
+
+        std::shared_ptr<UndoRecord> record;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include "FacilityCatalog.h"
+using std::string;
+
+// A selection policy defined by the user, from a config line or command
+//     policy <name> <expression> [only <category>...]
+// for example "policy green 2*eco + env - price/2 only 1 2". The expression adds up terms made of
+// one score (life, eco, env or price), integer factors and integer divisors; categories are
+// numbers as on facility lines, or life, eco and env. The definition is compiled once into an
+// integer weight per score column, and a plan using it builds the highest scoring facility of the
+// allowed categories, the first one on a tie.
+class WeightedPolicy
+{
+    public:
+        //Throws runtime_error saying what is wrong with the definition
+        WeightedPolicy(const string &name, const string &definition);
+        const string &getName() const;
+        const string &getDefinition() const;
+        //The best of best (-1 for none) and the allowed types from position first on; -1 if there is none
+        int findBest(const FacilityCatalog &facilitiesOptions, int first, int best) const;
+        //True when some facility in the options is of an allowed category
+        bool canSelect(const FacilityCatalog &facilitiesOptions) const;
+
+    private:
+        void compile();
+
+        string name;
+        string definition;
+        long long weights[FacilityCatalog::SCORE_COLUMNS];
+        bool allowed[3]; //Indexed by FacilityCategory
+};
@@ -4,11 +4,17 @@
 #include <vector>
 #include "Facility.h"
 #include "Settlement.h"
-#include <sstream>
 #include <iostream>
 #include "Simulation.h"
+#include <deque>
+#include <unordered_map>
 using namespace std;
-extern Simulation* backup;
+extern unordered_map<string, Simulation> backups;
+extern deque<shared_ptr<UndoRecord>> undoJournal;
+
+//Oldest entries are dropped beyond this many, or once the entries after them hold this many bytes
+const size_t UNDO_JOURNAL_LIMIT = 256;
+const size_t UNDO_JOURNAL_BYTES = size_t(256) << 20;
 enum class SettlementType;
 enum class FacilityCategory;
 
@@ -26,13 +32,52 @@ void BaseAction::complete(){
 void BaseAction::error(string errorMsg){
     status = ActionStatus::ERROR;
     this->errorMsg = errorMsg;
-    cout << "Error: " << errorMsg << endl;
+    TextWriter out(cout.rdbuf());
+    out << "Error: " << errorMsg << '\n';
+}
+
+//An entry keeps only what the action goes on to change, see UndoRecord.h
+void BaseAction::recordUndo(Simulation &simulation, bool replacing){
+    undoJournal.push_back(make_shared<UndoRecord>());
+    simulation.startUndoRecord(undoJournal.back(), replacing);
+    //The new entry is still empty and always stays; the ones before it are finished
+    size_t kept = 0;
+    size_t bytes = 0;
+    for (auto entry = undoJournal.rbegin(); entry != undoJournal.rend() && kept < UNDO_JOURNAL_LIMIT; ++entry) {
+        bytes += (*entry)->getBytes();
+        if (kept > 0 && bytes > UNDO_JOURNAL_BYTES) {
+            break;
+        }
+        kept++;
+    }
+    undoJournal.erase(undoJournal.begin(), undoJournal.end() - kept);
 }
 
 const string &BaseAction::getErrorMsg() const{
     return errorMsg;
 }
 
+//Formatted by the log, so this and the log line can never differ
+const string BaseAction::toString() const{
+    ActionLog log;
+    appendTo(log);
+    string line;
+    log.forEachLine([&line](string_view text) {
+        line = string(text);
+    });
+    return line;
+}
+
+LogRecord BaseAction::makeRecord(ActionLog &log, LogOpcode opcode) const{
+    LogRecord record = LogRecord();
+    record.opcode = opcode;
+    record.failed = status == ActionStatus::ERROR;
+    if (record.failed) {
+        record.errorMsg = log.intern(errorMsg);
+    }
+    return record;
+}
+
 string BaseAction::statusToString() const{
     if (status == ActionStatus::COMPLETED){
         return "COMPLETED";
@@ -46,14 +91,20 @@ string BaseAction::statusToString() const{
 SimulateStep::SimulateStep(const int numOfSteps) : numOfSteps(numOfSteps){}
 
 void SimulateStep::act(Simulation &simulation) {
-   for (int i = 0; i < numOfSteps; ++i) {
-        simulation.step();  
+    recordUndo(simulation);
+    try {
+        simulation.step(numOfSteps);
+    } catch (const runtime_error &e) {
+        error(e.what());
+        return;
     }
     complete();
 }
 
-const string SimulateStep::toString() const {
-    return "Step " + to_string(numOfSteps) + statusToString();
+void SimulateStep::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::STEP);
+    record.args[0] = numOfSteps;
+    log.append(record);
 }
 
 SimulateStep *SimulateStep::clone() const {
@@ -64,36 +115,28 @@ AddPlan::AddPlan(const string &settlementName, const string &selectionPolicy) :
 settlementName(settlementName), selectionPolicy(selectionPolicy) {}
 
 void AddPlan::act(Simulation &simulation){
-    
+    recordUndo(simulation);
     if (!simulation.isSettlementExists(settlementName)) {
         error("Cannot create this plan: Settlement does not exist");
         return;
     }
     
     Settlement* settlement = &simulation.getSettlement(settlementName);
-    SelectionPolicy* policy = nullptr;
-    // Switch-case to handle different selection policies
-    if (selectionPolicy == "nve") {
-        policy = new NaiveSelection(); 
-    } else if (selectionPolicy == "bal") {
-        policy = new BalancedSelection(0, 0, 0); 
-    } else if (selectionPolicy == "eco") {
-        policy = new EconomySelection(); 
-    } else if (selectionPolicy == "env") {
-        policy = new SustainabilitySelection(); 
-    } else {
+    SelectionPolicy policy;
+    if (!simulation.createSelectionPolicy(selectionPolicy, policy)) {
         error("Cannot create this plan: Invalid selection policy");
-    
+        return;
     }
-    
+
     simulation.addPlan(*settlement, policy);
-    delete policy;
-    policy = nullptr;
     complete();
 }
 
-const string AddPlan::toString() const {
-    return "Plan " + settlementName + " " + selectionPolicy + " " + BaseAction::statusToString();
+void AddPlan::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::PLAN);
+    record.args[0] = log.intern(settlementName);
+    record.args[1] = log.intern(selectionPolicy);
+    log.append(record);
 }
 
 AddPlan *AddPlan::clone() const {
@@ -105,6 +148,7 @@ AddSettlement::AddSettlement(const string &settlementName,SettlementType settlem
     settlementType(settlementType) {}
 
 void AddSettlement::act(Simulation &simulation) {
+    recordUndo(simulation);
     Settlement* toAdd = new Settlement(settlementName, settlementType);
     if(simulation.addSettlement(toAdd)){
         complete();
@@ -120,8 +164,11 @@ AddSettlement *AddSettlement::clone() const {
     return new AddSettlement(*this);
 }
 
-const string AddSettlement::toString() const {
-    return "Settlement " + settlementName + " " + to_string(static_cast<int>(settlementType)) + " " + statusToString();
+void AddSettlement::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::SETTLEMENT);
+    record.args[0] = log.intern(settlementName);
+    record.args[1] = static_cast<int>(settlementType);
+    log.append(record);
 }
 
 //AddFacility
@@ -134,6 +181,7 @@ AddFacility::AddFacility(const string &facilityName, const FacilityCategory faci
     environmentScore(environmentScore) {}
 
 void AddFacility::act(Simulation &simulation) {
+    recordUndo(simulation);
     const FacilityType& newFacility = FacilityType(facilityName, facilityCategory, price, lifeQualityScore, economyScore, environmentScore);
     if(simulation.addFacility(newFacility)){
         complete();
@@ -147,10 +195,15 @@ AddFacility *AddFacility::clone() const {
     return new AddFacility(*this);
 }
 
-const string AddFacility::toString() const {
-    return "Facility " + facilityName + " " + to_string(static_cast<int>(facilityCategory))
-           + " " + to_string(price) + " " + to_string(lifeQualityScore)
-           + " " + to_string(economyScore) + " " + to_string(environmentScore) + " " + BaseAction::statusToString();
+void AddFacility::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::FACILITY);
+    record.args[0] = log.intern(facilityName);
+    record.args[1] = static_cast<int>(facilityCategory);
+    record.args[2] = price;
+    record.args[3] = lifeQualityScore;
+    record.args[4] = economyScore;
+    record.args[5] = environmentScore;
+    log.append(record);
 }
 
 //PrintPlanStatus
@@ -158,12 +211,14 @@ PrintPlanStatus::PrintPlanStatus(int planId): planId(planId){}
 
 void PrintPlanStatus::act(Simulation &simulation) {
     
-    if (planId >= simulation.getPlanCounter()) {
+    if (planId < 0 || planId >= simulation.getPlanCounter()) {
         error("Plan doesn't exist");
-    
+
     } else {
-        Plan& plan = simulation.getPlan(planId);
-        cout << plan.toString() << endl;
+        TextWriter out(cout.rdbuf());
+        const Simulation &current = simulation; //Reading must not unshare the plan from backups
+        current.getPlan(planId).render(out, simulation.getFacilityOptions());
+        out << '\n';
         complete();
     }
 }
@@ -172,8 +227,10 @@ PrintPlanStatus *PrintPlanStatus::clone() const {
     return new PrintPlanStatus(*this);
 }
 
-const string PrintPlanStatus::toString() const {
-    return "PlanStatus: " + to_string(planId) + statusToString();
+void PrintPlanStatus::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::PLAN_STATUS);
+    record.args[0] = planId;
+    log.append(record);
 }
 
 
@@ -181,39 +238,30 @@ const string PrintPlanStatus::toString() const {
 ChangePlanPolicy::ChangePlanPolicy(const int planId, const string &newPolicy) :  planId(planId), newPolicy(newPolicy) {}
 
 void ChangePlanPolicy::act(Simulation &simulation) {
-    if(planId >= simulation.getPlanCounter()){
+    recordUndo(simulation);
+    if(planId < 0 || planId >= simulation.getPlanCounter()){
         error("Plan doesn't exist");
         return;
     }
     
     Plan& plan = simulation.getPlan(planId);
-    string prev = plan.getSelectionPolicy()->toString();
+    string prev = plan.getSelectionPolicy().toString();
     if (prev == newPolicy) {
         error("Cannot change selection policy: Same as current policy");
         return;
     }
 
-    SelectionPolicy *newSelectionPolicy = nullptr;
-    if (newPolicy == "nve") {
-        newSelectionPolicy = new NaiveSelection();
-    } else if (newPolicy == "bal") {
-        newSelectionPolicy = new BalancedSelection(
-            plan.getlifeQualityScore(),
-            plan.getEconomyScore(),
-            plan.getEnvironmentScore());
-    } else if (newPolicy == "eco") {
-        newSelectionPolicy = new EconomySelection();
-    } else if (newPolicy == "env") {
-        newSelectionPolicy = new SustainabilitySelection();
-    } else {
+    SelectionPolicy newSelectionPolicy;
+    if (!simulation.createSelectionPolicy(newPolicy, newSelectionPolicy, plan.getlifeQualityScore(), plan.getEconomyScore(), plan.getEnvironmentScore())) {
         error("Invalid selection policy");
         return;
     }
 
     plan.setSelectionPolicy(newSelectionPolicy);
-    cout << "Plan ID: " << planId << endl;
-    cout << "Previous Policy: " << prev << endl;
-    cout << "New Policy: " << newPolicy << endl;
+    TextWriter out(cout.rdbuf());
+    out << "Plan ID: " << planId << '\n';
+    out << "Previous Policy: " << prev << '\n';
+    out << "New Policy: " << newPolicy << '\n';
 
     complete();
 }
@@ -222,8 +270,37 @@ ChangePlanPolicy *ChangePlanPolicy::clone() const {
     return new ChangePlanPolicy(*this);
 }
 
-const string ChangePlanPolicy::toString() const {
-    return "ChangePlanPolicy " + to_string(planId) + " " + newPolicy + BaseAction::statusToString();
+void ChangePlanPolicy::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::CHANGE_POLICY);
+    record.args[0] = log.intern(newPolicy);
+    record.args[1] = planId;
+    log.append(record);
+}
+
+
+//DefinePolicy
+DefinePolicy::DefinePolicy(const string &policyName, const string &definition) : policyName(policyName), definition(definition) {}
+
+void DefinePolicy::act(Simulation &simulation) {
+    recordUndo(simulation);
+    try {
+        simulation.definePolicy(policyName, definition);
+    } catch (const runtime_error &e) {
+        error(e.what());
+        return;
+    }
+    complete();
+}
+
+DefinePolicy *DefinePolicy::clone() const {
+    return new DefinePolicy(*this);
+}
+
+void DefinePolicy::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::POLICY);
+    record.args[0] = log.intern(policyName);
+    record.args[1] = log.intern(definition);
+    log.append(record);
 }
 
 
@@ -231,9 +308,8 @@ const string ChangePlanPolicy::toString() const {
 PrintActionsLog::PrintActionsLog(){}
 
 void PrintActionsLog::act(Simulation &simulation) {
-    for(BaseAction* action : simulation.getActionsLog()){
-        cout << action->toString() << endl;
-    }
+    TextWriter out(cout.rdbuf());
+    simulation.getActionsLog().print(out);
     complete();
     
 }
@@ -242,8 +318,8 @@ PrintActionsLog *PrintActionsLog::clone() const {
     return new PrintActionsLog(*this);
 }
 
-const string PrintActionsLog::toString() const {
-    return "PrintActionsLog " + statusToString();
+void PrintActionsLog::appendTo(ActionLog &log) const {
+    log.append(makeRecord(log, LogOpcode::PRINT_LOG));
 }
 
 
@@ -259,44 +335,49 @@ Close *Close::clone() const {
     return new Close(*this);
 }
 
-const string Close::toString() const {
-    return "close " + statusToString();
+void Close::appendTo(ActionLog &log) const {
+    log.append(makeRecord(log, LogOpcode::CLOSE));
 }
 
 
 //BackupSimulation
-BackupSimulation::BackupSimulation(){
+BackupSimulation::BackupSimulation(const string &checkpointName) : checkpointName(checkpointName){
 }
 
+//Copying a simulation only shares its state, see CopyOnWrite.h
 void BackupSimulation::act(Simulation &simulation) {
-    if (backup == nullptr)
+    auto checkpoint = backups.find(checkpointName);
+    if (checkpoint == backups.end())
     {
-        backup = new Simulation(simulation);
+        backups.emplace(checkpointName, simulation);
     }
     else{
-        delete backup;
-        *backup = simulation;
+        checkpoint->second = simulation;
     }
     complete();
 }
 
 BackupSimulation *BackupSimulation::clone()const {
-    return new BackupSimulation();
+    return new BackupSimulation(*this);
 }
 
-const string BackupSimulation::toString() const {
-    return "backup " +  statusToString();
+void BackupSimulation::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::BACKUP);
+    record.args[0] = log.intern(checkpointName);
+    log.append(record);
 }
 
 //RestoreSimulation
-RestoreSimulation::RestoreSimulation(){}
+RestoreSimulation::RestoreSimulation(const string &checkpointName) : checkpointName(checkpointName){}
 
 void RestoreSimulation::act(Simulation &simulation){
-    if (backup == nullptr){
+    recordUndo(simulation, true);
+    auto checkpoint = backups.find(checkpointName);
+    if (checkpoint == backups.end()){
         error("no backup available");
     }
     else {
-        simulation = *backup;
+        simulation = checkpoint->second;
         complete();
     }
 
@@ -306,6 +387,82 @@ RestoreSimulation *RestoreSimulation::clone() const{
     return new RestoreSimulation(*this);
 }
 
-const string RestoreSimulation::toString() const {
-    return "restore " + statusToString();
+void RestoreSimulation::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::RESTORE);
+    record.args[0] = log.intern(checkpointName);
+    log.append(record);
+}
+
+//UndoActions
+UndoActions::UndoActions(const int numOfActions) : numOfActions(numOfActions){}
+
+void UndoActions::act(Simulation &simulation){
+    if (numOfActions < 1 || static_cast<size_t>(numOfActions) > undoJournal.size()){
+        error("Cannot undo " + to_string(numOfActions) + " actions: " + to_string(undoJournal.size()) + " recorded");
+        return;
+    }
+
+    //Newest first, each record taking back one action
+    for (int i = 0; i < numOfActions; ++i) {
+        simulation.undo(*undoJournal.back());
+        undoJournal.pop_back();
+    }
+    complete();
+}
+
+UndoActions *UndoActions::clone() const{
+    return new UndoActions(*this);
+}
+
+void UndoActions::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::UNDO);
+    record.args[0] = numOfActions;
+    log.append(record);
+}
+
+//SaveSimulation
+SaveSimulation::SaveSimulation(const string &filePath) : filePath(filePath){}
+
+void SaveSimulation::act(Simulation &simulation){
+    try {
+        simulation.saveSnapshot(filePath);
+    } catch (const runtime_error &e) {
+        error(e.what());
+        return;
+    }
+    complete();
+}
+
+SaveSimulation *SaveSimulation::clone() const{
+    return new SaveSimulation(*this);
+}
+
+void SaveSimulation::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::SAVE);
+    record.args[0] = log.intern(filePath);
+    log.append(record);
+}
+
+//LoadSimulation
+LoadSimulation::LoadSimulation(const string &filePath) : filePath(filePath){}
+
+void LoadSimulation::act(Simulation &simulation){
+    recordUndo(simulation, true);
+    try {
+        simulation.loadSnapshot(filePath);
+    } catch (const runtime_error &e) {
+        error(e.what());
+        return;
+    }
+    complete();
+}
+
+LoadSimulation *LoadSimulation::clone() const{
+    return new LoadSimulation(*this);
+}
+
+void LoadSimulation::appendTo(ActionLog &log) const {
+    LogRecord record = makeRecord(log, LogOpcode::LOAD);
+    record.args[0] = log.intern(filePath);
+    log.append(record);
 }
\ No newline at end of file
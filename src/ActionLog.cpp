@@ -0,0 +1,349 @@
+#include "ActionLog.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <stdexcept>
+#include <unistd.h>
+using namespace std;
+
+// Append-only text file of spilled log lines. Segments never move once written, so copies of
+// a log that went separate ways can keep appending to the same file.
+class ActionLog::SpillFile
+{
+    public:
+        explicit SpillFile(const string &path);
+        SpillFile(const SpillFile &other) = delete;
+        SpillFile &operator=(const SpillFile &other) = delete;
+        ~SpillFile();
+        Segment write(const string &text);
+        string read(const Segment &segment) const;
+
+    private:
+        [[noreturn]] void fail(const string &what) const;
+
+        string path;
+        int fd;
+        long long end;
+};
+
+ActionLog::SpillFile::SpillFile(const string &path) : path(path), fd(-1), end(0)
+{
+    if (path.empty())
+    {
+        char name[] = "/tmp/simulation-log-XXXXXX";
+        fd = mkstemp(name);
+        if (fd >= 0)
+        {
+            unlink(name);
+        }
+        this->path = "temporary file";
+    }
+    else
+    {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    if (fd < 0)
+    {
+        fail("open");
+    }
+}
+
+ActionLog::SpillFile::~SpillFile()
+{
+    close(fd);
+}
+
+ActionLog::Segment ActionLog::SpillFile::write(const string &text)
+{
+    const Segment segment{end, static_cast<long long>(text.size())};
+    size_t written = 0;
+    while (written < text.size())
+    {
+        const ssize_t count = pwrite(fd, text.data() + written, text.size() - written, end + written);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            fail("write");
+        }
+        written += count;
+    }
+    end += segment.length;
+    return segment;
+}
+
+string ActionLog::SpillFile::read(const Segment &segment) const
+{
+    string text(segment.length, '\0');
+    size_t done = 0;
+    while (done < text.size())
+    {
+        const ssize_t count = pread(fd, &text[done], text.size() - done, segment.offset + done);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            fail("read");
+        }
+        done += count;
+    }
+    return text;
+}
+
+void ActionLog::SpillFile::fail(const string &what) const
+{
+    throw runtime_error("Could not " + what + " log spill file: " + path);
+}
+
+// ActionLog
+ActionLog::ActionLog()
+    : records(), strings(), stringIndex(), segments(), spilledCount(0), limit(0), spillFile() {}
+
+int ActionLog::intern(string_view text)
+{
+    return internInto(strings, stringIndex, text);
+}
+
+void ActionLog::append(const LogRecord &record)
+{
+    records.push_back(record);
+    if (limit > 0 && records.size() > limit)
+    {
+        spill();
+    }
+}
+
+void ActionLog::appendLine(string_view line)
+{
+    LogRecord record = LogRecord();
+    record.opcode = LogOpcode::LINE;
+    record.args[0] = intern(line);
+    append(record);
+}
+
+int ActionLog::size() const
+{
+    return spilledCount + records.size();
+}
+
+void ActionLog::clear()
+{
+    records = ChunkedVector<LogRecord>();
+    strings = ChunkedVector<string>();
+    stringIndex = NameIndex();
+    segments = ChunkedVector<Segment>();
+    spilledCount = 0;
+}
+
+ActionLog ActionLog::withoutIndex() const
+{
+    ActionLog copy = *this;
+    copy.stringIndex = NameIndex();
+    return copy;
+}
+
+void ActionLog::rebuildIndex()
+{
+    stringIndex = NameIndex();
+    for (int i = 0; i < strings.size(); ++i)
+    {
+        stringIndex.add(strings[i], i);
+    }
+}
+
+void ActionLog::setLimit(int limit, const string &spillPath)
+{
+    this->limit = max(0, limit);
+    if (this->limit > 0)
+    {
+        spillFile = make_shared<SpillFile>(spillPath);
+    }
+    if (this->limit > 0 && records.size() > this->limit)
+    {
+        spill();
+    }
+}
+
+void ActionLog::forEachLine(const function<void(string_view)> &visit) const
+{
+    for (int i = 0; i < segments.size(); ++i)
+    {
+        const string text = spillFile->read(segments[i]);
+        size_t begin = 0;
+        for (size_t end = text.find('\n'); end != string::npos; end = text.find('\n', begin))
+        {
+            visit(string_view(text).substr(begin, end - begin));
+            begin = end + 1;
+        }
+    }
+    for (int i = 0; i < records.size(); ++i)
+    {
+        visit(format(records[i]));
+    }
+}
+
+//Spilled segments are already text, one line per entry, and are written out as they are
+void ActionLog::print(TextWriter &out) const
+{
+    for (int i = 0; i < segments.size(); ++i)
+    {
+        out << spillFile->read(segments[i]);
+    }
+    for (int i = 0; i < records.size(); ++i)
+    {
+        render(out, records[i]);
+        out << '\n';
+    }
+}
+
+string ActionLog::format(const LogRecord &record) const
+{
+    string text;
+    TextWriter out(text);
+    render(out, record);
+    out.flush();
+    return text;
+}
+
+//The text each action printed in the log before it was stored as a record
+void ActionLog::render(TextWriter &out, const LogRecord &record) const
+{
+    const int32_t *args = record.args;
+    switch (record.opcode)
+    {
+        case LogOpcode::STEP:
+            out << "Step " << args[0];
+            break;
+        case LogOpcode::PLAN:
+            out << "Plan " << strings[args[0]] << ' ' << strings[args[1]] << ' ';
+            break;
+        case LogOpcode::SETTLEMENT:
+            out << "Settlement " << strings[args[0]] << ' ' << args[1] << ' ';
+            break;
+        case LogOpcode::FACILITY:
+            out << "Facility " << strings[args[0]] << ' ' << args[1] << ' ' << args[2] << ' ' << args[3]
+                << ' ' << args[4] << ' ' << args[5] << ' ';
+            break;
+        case LogOpcode::PLAN_STATUS:
+            out << "PlanStatus: " << args[0];
+            break;
+        case LogOpcode::CHANGE_POLICY:
+            out << "ChangePlanPolicy " << args[1] << ' ' << strings[args[0]];
+            break;
+        case LogOpcode::PRINT_LOG:
+            out << "PrintActionsLog ";
+            break;
+        case LogOpcode::CLOSE:
+            out << "close ";
+            break;
+        case LogOpcode::BACKUP:
+        case LogOpcode::RESTORE:
+            out << (record.opcode == LogOpcode::BACKUP ? "backup " : "restore ");
+            if (!strings[args[0]].empty())
+            {
+                out << strings[args[0]] << ' ';
+            }
+            break;
+        case LogOpcode::UNDO:
+            out << "undo " << args[0] << ' ';
+            break;
+        case LogOpcode::SAVE:
+            out << "save " << strings[args[0]] << ' ';
+            break;
+        case LogOpcode::LOAD:
+            out << "load " << strings[args[0]] << ' ';
+            break;
+        case LogOpcode::POLICY:
+            out << "policy " << strings[args[0]] << ' ' << strings[args[1]] << ' ';
+            break;
+        case LogOpcode::LINE:
+            out << strings[args[0]];
+            return;
+    }
+    if (record.failed)
+    {
+        out << "ERROR: " << strings[record.errorMsg];
+    }
+    else
+    {
+        out << "COMPLETED";
+    }
+}
+
+// Writes the older half of the records out, then rebuilds the records and string pool from the
+// rest, so strings only the spilled records used are freed too. Rebuilding leaves the chunks
+// other copies share alone.
+void ActionLog::spill()
+{
+    const int count = max(1, limit / 2);
+    string text;
+    TextWriter out(text);
+    for (int i = 0; i < count; ++i)
+    {
+        render(out, records[i]);
+        out << '\n';
+    }
+    out.flush();
+    segments.push_back(spillFile->write(text));
+    spilledCount += count;
+
+    ChunkedVector<LogRecord> keptRecords;
+    ChunkedVector<string> keptStrings;
+    NameIndex keptIndex;
+    for (int i = count; i < records.size(); ++i)
+    {
+        LogRecord record = records[i];
+        for (int arg = 0; arg < stringArgumentCount(record.opcode); ++arg)
+        {
+            record.args[arg] = internInto(keptStrings, keptIndex, strings[record.args[arg]]);
+        }
+        if (record.failed)
+        {
+            record.errorMsg = internInto(keptStrings, keptIndex, strings[record.errorMsg]);
+        }
+        keptRecords.push_back(record);
+    }
+    records = keptRecords;
+    strings = keptStrings;
+    stringIndex = keptIndex;
+}
+
+int ActionLog::stringArgumentCount(LogOpcode opcode)
+{
+    switch (opcode)
+    {
+        case LogOpcode::PLAN:
+        case LogOpcode::POLICY:
+            return 2;
+        case LogOpcode::SETTLEMENT:
+        case LogOpcode::FACILITY:
+        case LogOpcode::CHANGE_POLICY:
+        case LogOpcode::BACKUP:
+        case LogOpcode::RESTORE:
+        case LogOpcode::SAVE:
+        case LogOpcode::LOAD:
+        case LogOpcode::LINE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int ActionLog::internInto(ChunkedVector<string> &strings, NameIndex &index, string_view text)
+{
+    const int id = index.find(text, [&strings](int position) -> const string & {
+        return strings[position];
+    });
+    if (id >= 0)
+    {
+        return id;
+    }
+    index.add(text, strings.size());
+    strings.push_back(string(text));
+    return strings.size() - 1;
+}
@@ -1,4 +1,6 @@
 #include "Auxiliary.h"
+#include <cctype>
+#include <charconv>
 /*
 This is a 'static' method that receives a string(line) and returns a vector of the string's arguments.
 
@@ -18,3 +20,53 @@ std::vector<std::string> Auxiliary::parseArguments(const std::string& line) {
 
     return arguments;
 }
+
+/*
+Same split as parseArguments, but the arguments are views into line, so nothing is allocated.
+Arguments past capacity are counted but not stored.
+*/
+int Auxiliary::splitArguments(std::string_view line, std::string_view *arguments, int capacity) {
+    int count = 0;
+    size_t position = 0;
+    while (position < line.size()) {
+        while (position < line.size() && std::isspace(static_cast<unsigned char>(line[position]))) {
+            position++;
+        }
+        if (position == line.size()) {
+            break;
+        }
+        const size_t start = position;
+        while (position < line.size() && !std::isspace(static_cast<unsigned char>(line[position]))) {
+            position++;
+        }
+        if (count < capacity) {
+            arguments[count] = line.substr(start, position - start);
+        }
+        count++;
+    }
+    return count;
+}
+
+std::string_view Auxiliary::restOfLine(std::string_view line, std::string_view argument) {
+    std::string_view rest = line.substr(argument.data() - line.data());
+    while (!rest.empty() && std::isspace(static_cast<unsigned char>(rest.back()))) {
+        rest.remove_suffix(1);
+    }
+    return rest;
+}
+
+/*
+Like stoi without the exceptions: an optional sign and the digits after it, ignoring whatever
+follows, so parseInteger("12abc") gives 12.
+*/
+bool Auxiliary::parseInteger(std::string_view text, int &value) {
+    if (text.size() > 1 && text[0] == '+' && text[1] != '-') {
+        text.remove_prefix(1);
+    }
+    const std::from_chars_result result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc();
+}
+
+bool Auxiliary::isTypeCode(int value) {
+    return value >= 0 && value <= 2;
+}
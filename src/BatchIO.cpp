@@ -0,0 +1,111 @@
+#include "BatchIO.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+using namespace std;
+
+//Both buffers start at this size; the reader's grows to fit a longer line
+static const size_t BATCH_BLOCK_BYTES = 1 << 20;
+
+// CommandReader
+CommandReader::CommandReader(int fd) : fd(fd), buffer(BATCH_BLOCK_BYTES), begin(0), end(0), finished(false) {}
+
+bool CommandReader::nextLine(string_view &line)
+{
+    while (true)
+    {
+        const void *lineBreak = memchr(buffer.data() + begin, '\n', end - begin);
+        if (lineBreak != nullptr)
+        {
+            const size_t lineEnd = static_cast<const char *>(lineBreak) - buffer.data();
+            line = string_view(buffer.data() + begin, lineEnd - begin);
+            begin = lineEnd + 1;
+            return true;
+        }
+        if (finished || !fill())
+        {
+            if (begin == end)
+            {
+                return false;
+            }
+            line = string_view(buffer.data() + begin, end - begin);
+            begin = end;
+            return true;
+        }
+    }
+}
+
+//Moves the unfinished line to the front and reads behind it; false at end of input
+bool CommandReader::fill()
+{
+    memmove(buffer.data(), buffer.data() + begin, end - begin);
+    end -= begin;
+    begin = 0;
+    if (end == buffer.size())
+    {
+        buffer.resize(buffer.size() * 2);
+    }
+
+    ssize_t count;
+    do
+    {
+        count = read(fd, buffer.data() + end, buffer.size() - end);
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0)
+    {
+        finished = true;
+        return false;
+    }
+    end += count;
+    return true;
+}
+
+// BatchOutput
+BatchOutput::BatchOutput(int fd) : fd(fd), buffer(BATCH_BLOCK_BYTES)
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+BatchOutput::~BatchOutput()
+{
+    drain();
+}
+
+BatchOutput::int_type BatchOutput::overflow(int_type ch)
+{
+    if (!drain())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int BatchOutput::sync()
+{
+    return drain() ? 0 : -1;
+}
+
+bool BatchOutput::drain()
+{
+    const char *next = pbase();
+    while (next < pptr())
+    {
+        const ssize_t count = write(fd, next, pptr() - next);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        next += count;
+    }
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return true;
+}
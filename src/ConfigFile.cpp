@@ -0,0 +1,204 @@
+#include "ConfigFile.h"
+#include "Auxiliary.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+//Bytes per parse task; small files stay in one chunk and never touch the pool
+static const size_t CONFIG_CHUNK_BYTES = 1 << 20;
+//Longest line kept whole: "facility" plus its six arguments
+static const int MAX_CONFIG_ARGUMENTS = 7;
+
+ConfigFile::ConfigFile(const string &path) : path(path), data(nullptr), size(0)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw runtime_error("Could not open configuration file: " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw runtime_error("Could not open configuration file: " + path);
+    }
+    size = static_cast<size_t>(info.st_size);
+    if (size == 0)
+    {
+        close(fd);
+        return;
+    }
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw runtime_error("Could not map configuration file: " + path);
+    }
+    data = static_cast<const char *>(mapping);
+    madvise(mapping, size, MADV_SEQUENTIAL);
+}
+
+ConfigFile::~ConfigFile()
+{
+    if (data != nullptr)
+    {
+        munmap(const_cast<char *>(data), size);
+    }
+}
+
+vector<ConfigEntry> ConfigFile::parse(ThreadPool *pool) const
+{
+    vector<Chunk> chunks;
+    for (size_t begin = 0; begin < size;)
+    {
+        size_t end = min(size, begin + CONFIG_CHUNK_BYTES);
+        if (end < size)
+        {
+            const void *lineBreak = memchr(data + end, '\n', size - end);
+            end = lineBreak == nullptr ? size : static_cast<const char *>(lineBreak) - data + 1;
+        }
+        chunks.push_back(Chunk{begin, end, 0, vector<ConfigEntry>(), 0, string()});
+        begin = end;
+    }
+
+    const function<void(int, int)> parseRange = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            parseChunk(chunks[i]);
+        }
+    };
+    if (pool != nullptr)
+    {
+        pool->parallelFor(0, static_cast<int>(chunks.size()), 1, parseRange);
+    }
+    else
+    {
+        parseRange(0, static_cast<int>(chunks.size()));
+    }
+
+    //Chunks number their lines from 1; shift them by the lines of the chunks before
+    size_t entryCount = 0;
+    for (const Chunk &chunk : chunks)
+    {
+        entryCount += chunk.entries.size();
+    }
+    vector<ConfigEntry> entries;
+    entries.reserve(entryCount);
+    int firstLine = 0;
+    for (const Chunk &chunk : chunks)
+    {
+        if (chunk.errorLine != 0)
+        {
+            fail(firstLine + chunk.errorLine, chunk.error);
+        }
+        for (ConfigEntry entry : chunk.entries)
+        {
+            entry.line += firstLine;
+            entries.push_back(entry);
+        }
+        firstLine += chunk.lineCount;
+    }
+    return entries;
+}
+
+void ConfigFile::fail(int line, const string &reason) const
+{
+    throw runtime_error("Invalid configuration file: " + path + ", line " + to_string(line) + " (" + reason + ")");
+}
+
+//Stops at the first bad line, since nothing after it is used
+void ConfigFile::parseChunk(Chunk &chunk) const
+{
+    size_t position = chunk.begin;
+    while (position < chunk.end)
+    {
+        const void *lineBreak = memchr(data + position, '\n', chunk.end - position);
+        const size_t lineEnd = lineBreak == nullptr ? chunk.end : static_cast<const char *>(lineBreak) - data;
+        chunk.lineCount++;
+
+        ConfigEntry entry;
+        const LineResult result = parseLine(string_view(data + position, lineEnd - position), entry, chunk.error);
+        if (result == MALFORMED)
+        {
+            chunk.errorLine = chunk.lineCount;
+            return;
+        }
+        if (result == PARSED)
+        {
+            entry.line = chunk.lineCount;
+            chunk.entries.push_back(entry);
+        }
+        position = lineEnd + 1;
+    }
+}
+
+// A line that is not a settlement, facility, policy or plan (blank, comment or anything else) is
+// skipped, as the getline loop this replaced did. error is only set for MALFORMED.
+ConfigFile::LineResult ConfigFile::parseLine(string_view line, ConfigEntry &entry, string &error)
+{
+    string_view arguments[MAX_CONFIG_ARGUMENTS];
+    const int count = Auxiliary::splitArguments(line, arguments, MAX_CONFIG_ARGUMENTS);
+    int expected;
+    if (count > 0 && arguments[0] == "settlement")
+    {
+        entry.kind = ConfigEntry::SETTLEMENT;
+        expected = 3;
+    }
+    else if (count > 0 && arguments[0] == "facility")
+    {
+        entry.kind = ConfigEntry::FACILITY;
+        expected = 7;
+    }
+    else if (count > 0 && arguments[0] == "plan")
+    {
+        entry.kind = ConfigEntry::PLAN;
+        expected = 3;
+    }
+    else if (count > 0 && arguments[0] == "policy")
+    {
+        entry.kind = ConfigEntry::POLICY;
+        expected = 3;
+    }
+    else
+    {
+        return SKIPPED;
+    }
+    if (count < expected)
+    {
+        error = string(arguments[0]) + " needs " + to_string(expected - 1) + " arguments";
+        return MALFORMED;
+    }
+
+    entry.name = arguments[1];
+    entry.policy = string_view();
+    //Policy names are checked when the plan is added, since the file may define its own
+    if (entry.kind == ConfigEntry::PLAN)
+    {
+        entry.policy = arguments[2];
+        return PARSED;
+    }
+    if (entry.kind == ConfigEntry::POLICY)
+    {
+        entry.policy = Auxiliary::restOfLine(line, arguments[2]);
+        return PARSED;
+    }
+    for (int i = 2; i < expected; ++i)
+    {
+        if (!Auxiliary::parseInteger(arguments[i], entry.values[i - 2]))
+        {
+            error = "invalid number: " + string(arguments[i]);
+            return MALFORMED;
+        }
+    }
+    if (!Auxiliary::isTypeCode(entry.values[0]))
+    {
+        error = "invalid " + string(entry.kind == ConfigEntry::SETTLEMENT ? "settlement type" : "facility category") + ": " + string(arguments[2]);
+        return MALFORMED;
+    }
+    return PARSED;
+}
@@ -0,0 +1,151 @@
+#include "ConstructionScheduler.h"
+#include <algorithm>
+using namespace std;
+
+ConstructionScheduler::ConstructionScheduler() : readyPlans(), completions(), wakeups() {}
+
+void ConstructionScheduler::markReady(int planId)
+{
+    readyPlans.write().push_back(planId);
+}
+
+bool ConstructionScheduler::hasReady() const
+{
+    return !readyPlans->empty();
+}
+
+void ConstructionScheduler::takeReady(vector<int> &planIds)
+{
+    planIds.assign(readyPlans->begin(), readyPlans->end());
+    readyPlans.write().clear();
+    sort(planIds.begin(), planIds.end());
+    planIds.erase(unique(planIds.begin(), planIds.end()), planIds.end());
+}
+
+void ConstructionScheduler::scheduleCompletion(long long tick, int planId)
+{
+    completions.write().push(Event(tick, planId));
+}
+
+bool ConstructionScheduler::hasCompletions() const
+{
+    return !completions->empty();
+}
+
+long long ConstructionScheduler::getNextCompletionTick() const
+{
+    return completions->top().first;
+}
+
+bool ConstructionScheduler::popCompletion(long long tick, int &planId)
+{
+    if (completions->empty() || completions->top().first > tick)
+    {
+        return false;
+    }
+
+    planId = completions->top().second;
+    completions.write().pop();
+    return true;
+}
+
+void ConstructionScheduler::scheduleWakeup(long long tick, int planId)
+{
+    wakeups.write().push(Event(tick, planId));
+}
+
+bool ConstructionScheduler::hasWakeups() const
+{
+    return !wakeups->empty();
+}
+
+long long ConstructionScheduler::getNextWakeupTick() const
+{
+    return wakeups->top().first;
+}
+
+bool ConstructionScheduler::popWakeup(long long tick, int &planId)
+{
+    if (wakeups->empty() || wakeups->top().first > tick)
+    {
+        return false;
+    }
+
+    planId = wakeups->top().second;
+    wakeups.write().pop();
+    return true;
+}
+
+ConstructionScheduler::UndoState ConstructionScheduler::getUndoState() const
+{
+    return UndoState{readyPlans, wakeups};
+}
+
+void ConstructionScheduler::restore(const UndoState &state, const ConstructionTable &constructions)
+{
+    readyPlans = state.readyPlans;
+    wakeups = state.wakeups;
+    vector<Event> events;
+    events.reserve(constructions.size());
+    for (int row = 0; row < constructions.size(); ++row)
+    {
+        events.emplace_back(constructions.getFinishTick(row), constructions.getPlanId(row));
+    }
+    completions = CowPtr<EventQueue>(); //A fresh queue, so copies sharing the old one are not copied
+    completions.write() = EventQueue(std::greater<Event>(), move(events));
+}
+
+void ConstructionScheduler::save(SnapshotWriter &writer) const
+{
+    writer.writeI32(static_cast<int32_t>(readyPlans->size()));
+    for (int planId : *readyPlans)
+    {
+        writer.writeI32(planId);
+    }
+    saveEvents(writer, *completions);
+    saveEvents(writer, *wakeups);
+}
+
+void ConstructionScheduler::load(SnapshotReader &reader, int planCount)
+{
+    const int readyCount = reader.readCount(planCount);
+    for (int i = 0; i < readyCount; ++i)
+    {
+        const int planId = reader.readI32();
+        if (planId < 0 || planId >= planCount)
+        {
+            reader.fail("bad ready plan");
+        }
+        readyPlans.write().push_back(planId);
+    }
+    loadEvents(reader, planCount, completions.write());
+    loadEvents(reader, planCount, wakeups.write());
+}
+
+//Takes the queue by value and drains the copy, which writes the events in tick order
+void ConstructionScheduler::saveEvents(SnapshotWriter &writer, EventQueue events)
+{
+    writer.writeI32(static_cast<int32_t>(events.size()));
+    while (!events.empty())
+    {
+        writer.writeI64(events.top().first);
+        writer.writeI32(events.top().second);
+        events.pop();
+    }
+}
+
+void ConstructionScheduler::loadEvents(SnapshotReader &reader, int planCount, EventQueue &events)
+{
+    vector<Event> loaded;
+    loaded.resize(reader.readCount(INT32_MAX, sizeof(int64_t) + sizeof(int32_t)));
+    for (Event &event : loaded)
+    {
+        event.first = reader.readI64();
+        event.second = reader.readI32();
+        if (event.second < 0 || event.second >= planCount)
+        {
+            reader.fail("bad event");
+        }
+    }
+    events = EventQueue(std::greater<Event>(), move(loaded));
+}
@@ -0,0 +1,151 @@
+#include "ConstructionTable.h"
+using namespace std;
+
+ConstructionTable::ConstructionTable()
+    : finishTick(), planId(), facilityIndex(), lifeQualityDelta(), economyDelta(), environmentDelta() {}
+
+// Same timing as Facility::step: a facility costing N started on tick T is found at zero,
+// and so becomes operational, on tick T + N.
+int ConstructionTable::add(int planId, int facilityIndex, const FacilityType &facilityType, long long startTick)
+{
+    finishTick.push_back(startTick + facilityType.getCost());
+    this->planId.push_back(planId);
+    this->facilityIndex.push_back(facilityIndex);
+    lifeQualityDelta.push_back(facilityType.getLifeQualityScore());
+    economyDelta.push_back(facilityType.getEconomyScore());
+    environmentDelta.push_back(facilityType.getEnvironmentScore());
+    return size() - 1;
+}
+
+int ConstructionTable::size() const
+{
+    return static_cast<int>(finishTick.size());
+}
+
+bool ConstructionTable::isCompleted(int row, long long tick) const
+{
+    return finishTick[row] <= tick;
+}
+
+int ConstructionTable::getPlanId(int row) const
+{
+    return planId[row];
+}
+
+int ConstructionTable::getFacilityIndex(int row) const
+{
+    return facilityIndex[row];
+}
+
+long long ConstructionTable::getFinishTick(int row) const
+{
+    return finishTick[row];
+}
+
+int ConstructionTable::getTimeLeft(int row, long long tick) const
+{
+    return finishTick[row] > tick ? static_cast<int>(finishTick[row] - tick) : 0;
+}
+
+int ConstructionTable::getLifeQualityDelta(int row) const
+{
+    return lifeQualityDelta[row];
+}
+
+int ConstructionTable::getEconomyDelta(int row) const
+{
+    return economyDelta[row];
+}
+
+int ConstructionTable::getEnvironmentDelta(int row) const
+{
+    return environmentDelta[row];
+}
+
+void ConstructionTable::delay(int row, long long ticks)
+{
+    finishTick[row] += ticks;
+}
+
+// The moved row's plan has to be told it is now at row. When removing several rows,
+// remove the highest index first.
+int ConstructionTable::remove(int row)
+{
+    const int last = size() - 1;
+    int movedPlan = -1;
+    if (row != last)
+    {
+        finishTick[row] = finishTick[last];
+        planId[row] = planId[last];
+        facilityIndex[row] = facilityIndex[last];
+        lifeQualityDelta[row] = lifeQualityDelta[last];
+        economyDelta[row] = economyDelta[last];
+        environmentDelta[row] = environmentDelta[last];
+        movedPlan = planId[row];
+    }
+
+    finishTick.pop_back();
+    planId.pop_back();
+    facilityIndex.pop_back();
+    lifeQualityDelta.pop_back();
+    economyDelta.pop_back();
+    environmentDelta.pop_back();
+    return movedPlan;
+}
+
+ConstructionTable::Row ConstructionTable::getRow(int row) const
+{
+    return Row{finishTick[row], planId[row], facilityIndex[row], lifeQualityDelta[row], economyDelta[row], environmentDelta[row]};
+}
+
+void ConstructionTable::setRow(int row, const Row &values)
+{
+    finishTick[row] = values.finishTick;
+    planId[row] = values.planId;
+    facilityIndex[row] = values.facilityIndex;
+    lifeQualityDelta[row] = values.lifeQualityDelta;
+    economyDelta[row] = values.economyDelta;
+    environmentDelta[row] = values.environmentDelta;
+}
+
+void ConstructionTable::resize(int count)
+{
+    finishTick.resize(count);
+    planId.resize(count);
+    facilityIndex.resize(count);
+    lifeQualityDelta.resize(count);
+    economyDelta.resize(count);
+    environmentDelta.resize(count);
+}
+
+void ConstructionTable::save(SnapshotWriter &writer) const
+{
+    writer.writeI32(size());
+    for (int row = 0; row < size(); ++row)
+    {
+        writer.writeI64(finishTick[row]);
+        writer.writeI32(planId[row]);
+        writer.writeI32(facilityIndex[row]);
+        writer.writeI32(lifeQualityDelta[row]);
+        writer.writeI32(economyDelta[row]);
+        writer.writeI32(environmentDelta[row]);
+    }
+}
+
+void ConstructionTable::load(SnapshotReader &reader, int planCount, int facilityCount)
+{
+    const int rows = reader.readCount(planCount * MAX_CONSTRUCTION_LIMIT, sizeof(int64_t) + 5 * sizeof(int32_t));
+    for (int row = 0; row < rows; ++row)
+    {
+        finishTick.push_back(reader.readI64());
+        planId.push_back(reader.readI32());
+        facilityIndex.push_back(reader.readI32());
+        lifeQualityDelta.push_back(reader.readI32());
+        economyDelta.push_back(reader.readI32());
+        environmentDelta.push_back(reader.readI32());
+        if (planId.back() < 0 || planId.back() >= planCount || facilityIndex.back() < 0 || facilityIndex.back() >= facilityCount)
+        {
+            reader.fail("bad construction row");
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#include "CycleDetector.h"
+using namespace std;
+
+CycleDetector::CycleDetector() : marks(), active(true) {}
+
+const CycleDetector::Mark *CycleDetector::findOrRecord(const vector<long long> &key, const Mark &mark)
+{
+    auto found = marks.find(key);
+    if (found != marks.end())
+    {
+        return &found->second;
+    }
+
+    if (marks.size() >= MAX_MARKS)
+    {
+        stop();
+        return nullptr;
+    }
+    marks.emplace(key, mark);
+    return nullptr;
+}
+
+bool CycleDetector::isActive() const
+{
+    return active;
+}
+
+void CycleDetector::stop()
+{
+    active = false;
+    marks.clear();
+}
+
+//FNV-1a over the values
+size_t CycleDetector::KeyHash::operator()(const vector<long long> &key) const
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (long long value : key)
+    {
+        hash ^= static_cast<unsigned long long>(value);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
@@ -1,5 +1,5 @@
 #include "Facility.h"
-#include <sstream>
+#include "Settlement.h"
 #include <unordered_map>
 
 using namespace std;
@@ -37,18 +37,35 @@ FacilityCategory FacilityType::getCategory() const
     return category;
 }
 
-Facility::Facility(const string &name, const string &settlementName, const FacilityCategory category, const int price, const int lifeQuality_score, const int economy_score, const int environment_score)
-    : FacilityType(name, category, price, lifeQuality_score, economy_score, environment_score), settlementName(settlementName), status(FacilityStatus::UNDER_CONSTRUCTIONS), timeLeft(price) {}
+Facility::Facility(const int facilityId, const int settlementId, const int timeLeft)
+    : facilityId(static_cast<uint32_t>(facilityId)),
+      settlementId(static_cast<uint32_t>(settlementId)),
+      timeLeft(timeLeft),
+      status(FacilityStatus::UNDER_CONSTRUCTIONS) {}
 
-Facility::Facility(const FacilityType &type, const string &settlementName)
-    : FacilityType(type),
-      settlementName(settlementName),
-      status(FacilityStatus::UNDER_CONSTRUCTIONS),
-      timeLeft(type.getCost()) {}
+int Facility::getFacilityId() const
+{
+    return static_cast<int>(facilityId);
+}
+
+int Facility::getSettlementId() const
+{
+    return static_cast<int>(settlementId);
+}
+
+const FacilityType &Facility::getType(const vector<FacilityType> &facilityOptions) const
+{
+    return facilityOptions[facilityId];
+}
+
+const string &Facility::getName(const vector<FacilityType> &facilityOptions) const
+{
+    return facilityOptions[facilityId].getName();
+}
 
-const string &Facility::getSettlementName() const
+const string &Facility::getSettlementName(const ChunkedVector<shared_ptr<Settlement>> &settlements) const
 {
-    return settlementName;
+    return settlements[settlementId]->getName();
 }
 
 const int Facility::getTimeLeft() const
@@ -74,6 +91,10 @@ FacilityStatus Facility::step()
 void Facility::setStatus(FacilityStatus status)
 {
     this->status = status;
+    if (status == FacilityStatus::OPERATIONAL)
+    {
+        timeLeft = 0;
+    }
 }
 
 const FacilityStatus &Facility::getStatus() const
@@ -81,46 +102,48 @@ const FacilityStatus &Facility::getStatus() const
     return status;
 }
 
-const string Facility::toString() const
+const string Facility::toString(const vector<FacilityType> &facilityOptions, const ChunkedVector<shared_ptr<Settlement>> &settlements) const
+{
+    string text;
+    TextWriter out(text);
+    render(out, facilityOptions, settlements);
+    out.flush();
+    return text;
+}
+
+void Facility::render(TextWriter &out, const vector<FacilityType> &facilityOptions, const ChunkedVector<shared_ptr<Settlement>> &settlements) const
 {
-    ostringstream oss;
-    oss << "Facility Name: " << name << ", Category: ";
+    const FacilityType &type = getType(facilityOptions);
+    out << "Facility Name: " << type.getName() << ", Category: ";
 
-    switch (category)
+    switch (type.getCategory())
     {
     case FacilityCategory::LIFE_QUALITY:
-        oss << "Life Quality";
+        out << "Life Quality";
         break;
     case FacilityCategory::ECONOMY:
-        oss << "Economy";
+        out << "Economy";
         break;
     case FacilityCategory::ENVIRONMENT:
-        oss << "Environment";
+        out << "Environment";
         break;
     default:
-        oss << "Unknown Category";
+        out << "Unknown Category";
     }
 
-    oss << ", Status: ";
+    out << ", Status: ";
 
     switch (status)
     {
     case FacilityStatus::UNDER_CONSTRUCTIONS:
-        oss << "Under Construction";
+        out << "Under Construction";
         break;
     case FacilityStatus::OPERATIONAL:
-        oss << "Operational";
+        out << "Operational";
         break;
     default:
-        oss << "Unknown Status";
+        out << "Unknown Status";
     }
 
-    oss << ", Associated Settlement: " << settlementName;
-
-    return oss.str();
-}
-
-Facility *Facility::clone() const
-{
-    return new Facility(*this);
+    out << ", Associated Settlement: " << getSettlementName(settlements);
 }
@@ -0,0 +1,332 @@
+#include "FacilityCatalog.h"
+#include <algorithm>
+#include <climits>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FACILITY_CATALOG_X86
+#endif
+using namespace std;
+
+// Balance scans. Each returns the first position whose max - min of the three offset scores is
+// the smallest; the vector versions keep the best balance and its position per lane, where lanes
+// only take strictly smaller balances, then settle ties between lanes on the lowest position
+typedef int (*BalanceScanFunction)(const int *lifeQuality, const int *economy, const int *environment, int count, int lifeQualityOffset, int economyOffset, int environmentOffset);
+
+//Continues a scan from first, given the best balance and position before it
+static int finishBalanceScan(const int *lifeQuality, const int *economy, const int *environment, int first, int count, int lifeQualityOffset, int economyOffset, int environmentOffset, int bestBalance, int bestIndex)
+{
+    for (int i = first; i < count; ++i)
+    {
+        const int possibleLifeQuality = lifeQuality[i] + lifeQualityOffset;
+        const int possibleEconomy = economy[i] + economyOffset;
+        const int possibleEnvironment = environment[i] + environmentOffset;
+        const int balance = max({possibleLifeQuality, possibleEconomy, possibleEnvironment}) - min({possibleLifeQuality, possibleEconomy, possibleEnvironment});
+        if (balance < bestBalance)
+        {
+            bestBalance = balance;
+            bestIndex = i;
+        }
+    }
+    return bestIndex;
+}
+
+static int scanBalanceScalar(const int *lifeQuality, const int *economy, const int *environment, int count, int lifeQualityOffset, int economyOffset, int environmentOffset)
+{
+    return finishBalanceScan(lifeQuality, economy, environment, 0, count, lifeQualityOffset, economyOffset, environmentOffset, INT_MAX, 0);
+}
+
+#ifdef FACILITY_CATALOG_X86
+//Settles the lanes, then scans what did not fill a whole vector
+static int mergeBalanceLanes(const int *balances, const int *indices, int lanes, const int *lifeQuality, const int *economy, const int *environment, int first, int count, int lifeQualityOffset, int economyOffset, int environmentOffset)
+{
+    int bestBalance = INT_MAX;
+    int bestIndex = 0;
+    for (int lane = 0; lane < lanes; ++lane)
+    {
+        if (balances[lane] < bestBalance || (balances[lane] == bestBalance && indices[lane] < bestIndex))
+        {
+            bestBalance = balances[lane];
+            bestIndex = indices[lane];
+        }
+    }
+    return finishBalanceScan(lifeQuality, economy, environment, first, count, lifeQualityOffset, economyOffset, environmentOffset, bestBalance, bestIndex);
+}
+
+__attribute__((target("sse4.1")))
+static int scanBalanceSse41(const int *lifeQuality, const int *economy, const int *environment, int count, int lifeQualityOffset, int economyOffset, int environmentOffset)
+{
+    const __m128i lifeQualityBase = _mm_set1_epi32(lifeQualityOffset);
+    const __m128i economyBase = _mm_set1_epi32(economyOffset);
+    const __m128i environmentBase = _mm_set1_epi32(environmentOffset);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i bestBalance = _mm_set1_epi32(INT_MAX);
+    __m128i bestIndex = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i a = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lifeQuality + i)), lifeQualityBase);
+        const __m128i b = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(economy + i)), economyBase);
+        const __m128i c = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(environment + i)), environmentBase);
+        const __m128i balance = _mm_sub_epi32(_mm_max_epi32(_mm_max_epi32(a, b), c), _mm_min_epi32(_mm_min_epi32(a, b), c));
+        const __m128i better = _mm_cmpgt_epi32(bestBalance, balance);
+        bestBalance = _mm_blendv_epi8(bestBalance, balance, better);
+        bestIndex = _mm_blendv_epi8(bestIndex, index, better);
+        index = _mm_add_epi32(index, step);
+    }
+    int balances[4], indices[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(balances), bestBalance);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(indices), bestIndex);
+    return mergeBalanceLanes(balances, indices, 4, lifeQuality, economy, environment, i, count, lifeQualityOffset, economyOffset, environmentOffset);
+}
+
+__attribute__((target("avx2")))
+static int scanBalanceAvx2(const int *lifeQuality, const int *economy, const int *environment, int count, int lifeQualityOffset, int economyOffset, int environmentOffset)
+{
+    const __m256i lifeQualityBase = _mm256_set1_epi32(lifeQualityOffset);
+    const __m256i economyBase = _mm256_set1_epi32(economyOffset);
+    const __m256i environmentBase = _mm256_set1_epi32(environmentOffset);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i bestBalance = _mm256_set1_epi32(INT_MAX);
+    __m256i bestIndex = _mm256_setzero_si256();
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i a = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(lifeQuality + i)), lifeQualityBase);
+        const __m256i b = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(economy + i)), economyBase);
+        const __m256i c = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(environment + i)), environmentBase);
+        const __m256i balance = _mm256_sub_epi32(_mm256_max_epi32(_mm256_max_epi32(a, b), c), _mm256_min_epi32(_mm256_min_epi32(a, b), c));
+        const __m256i better = _mm256_cmpgt_epi32(bestBalance, balance);
+        bestBalance = _mm256_blendv_epi8(bestBalance, balance, better);
+        bestIndex = _mm256_blendv_epi8(bestIndex, index, better);
+        index = _mm256_add_epi32(index, step);
+    }
+    int balances[8], indices[8];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(balances), bestBalance);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(indices), bestIndex);
+    return mergeBalanceLanes(balances, indices, 8, lifeQuality, economy, environment, i, count, lifeQualityOffset, economyOffset, environmentOffset);
+}
+#endif
+
+//The scans add the scores to int offsets, while the scores a plan has gathered are long long. Only
+//differences between balances in one scan matter, so the three offsets can all move by the same
+//amount. And an offset more than the catalog's score spread above the middle one gives the highest
+//of the three scores for every type, so moving it down to spread + 1 above the middle one lowers
+//every balance alike; the same goes for one far below. Once that is done the sums stay within
+//[-(spread + 1), 2 * spread + 1]. False when the spread is too wide for int lanes even then
+static bool narrowBalanceOffsets(const long long *offsets, int lowestScore, int highestScore, int *narrowed)
+{
+    const long long spread = static_cast<long long>(highestScore) - lowestScore;
+    if (spread > INT_MAX / 4)
+    {
+        return false;
+    }
+    const long long middle = max(min(offsets[0], offsets[1]), min(max(offsets[0], offsets[1]), offsets[2]));
+    for (int i = 0; i < 3; ++i)
+    {
+        const long long offset = max(-spread - 1, min(spread + 1, offsets[i] - middle)) - lowestScore;
+        if (offset < INT_MIN || offset > INT_MAX)
+        {
+            return false;
+        }
+        narrowed[i] = static_cast<int>(offset);
+    }
+    return true;
+}
+
+//What the scans do, on long long sums, for the catalogs narrowBalanceOffsets turns down
+static int scanBalanceWide(const int *lifeQuality, const int *economy, const int *environment, int count, const long long *offsets)
+{
+    long long bestBalance = LLONG_MAX;
+    int bestIndex = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const long long possibleLifeQuality = lifeQuality[i] + offsets[0];
+        const long long possibleEconomy = economy[i] + offsets[1];
+        const long long possibleEnvironment = environment[i] + offsets[2];
+        const long long balance = max({possibleLifeQuality, possibleEconomy, possibleEnvironment}) - min({possibleLifeQuality, possibleEconomy, possibleEnvironment});
+        if (balance < bestBalance)
+        {
+            bestBalance = balance;
+            bestIndex = i;
+        }
+    }
+    return bestIndex;
+}
+
+//Null for the vector scans on other processors than x86
+static BalanceScanFunction getBalanceScanFunction(FacilityCatalog::BalanceScan scan)
+{
+    switch (scan)
+    {
+#ifdef FACILITY_CATALOG_X86
+        case FacilityCatalog::BalanceScan::AVX2:
+            return scanBalanceAvx2;
+        case FacilityCatalog::BalanceScan::SSE41:
+            return scanBalanceSse41;
+#endif
+        case FacilityCatalog::BalanceScan::SCALAR:
+            return scanBalanceScalar;
+        default:
+            return nullptr;
+    }
+}
+
+//The widest scan this processor runs
+static FacilityCatalog::BalanceScan chooseBalanceScan()
+{
+    for (FacilityCatalog::BalanceScan scan : {FacilityCatalog::BalanceScan::AVX2, FacilityCatalog::BalanceScan::SSE41})
+    {
+        if (FacilityCatalog::canRun(scan))
+        {
+            return scan;
+        }
+    }
+    return FacilityCatalog::BalanceScan::SCALAR;
+}
+
+// FacilityCatalog
+bool FacilityCatalog::canRun(BalanceScan scan)
+{
+#ifdef FACILITY_CATALOG_X86
+    __builtin_cpu_init();
+    if (scan == BalanceScan::AVX2)
+    {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (scan == BalanceScan::SSE41)
+    {
+        return __builtin_cpu_supports("sse4.1");
+    }
+#endif
+    return scan == BalanceScan::SCALAR;
+}
+
+const char *FacilityCatalog::getName(BalanceScan scan)
+{
+    static const char *const NAMES[] = {"scalar", "sse4.1", "avx2"};
+    return NAMES[static_cast<int>(scan)];
+}
+
+FacilityCatalog::FacilityCatalog() : types(), lifeQualityScores(), economyScores(), environmentScores(), prices(), categoryPositions(), lowestScore(0), highestScore(0) {}
+
+void FacilityCatalog::add(FacilityType type)
+{
+    const int lowest = min({type.getLifeQualityScore(), type.getEconomyScore(), type.getEnvironmentScore()});
+    const int highest = max({type.getLifeQualityScore(), type.getEconomyScore(), type.getEnvironmentScore()});
+    lowestScore = empty() ? lowest : min(lowestScore, lowest);
+    highestScore = empty() ? highest : max(highestScore, highest);
+    lifeQualityScores.push_back(type.getLifeQualityScore());
+    economyScores.push_back(type.getEconomyScore());
+    environmentScores.push_back(type.getEnvironmentScore());
+    prices.push_back(type.getCost());
+    categoryPositions[static_cast<int>(type.getCategory())].push_back(size());
+    types.push_back(move(type));
+}
+
+void FacilityCatalog::reserve(int count)
+{
+    types.reserve(count);
+    lifeQualityScores.reserve(count);
+    economyScores.reserve(count);
+    environmentScores.reserve(count);
+    prices.reserve(count);
+}
+
+void FacilityCatalog::truncate(int count)
+{
+    while (size() > count)
+    {
+        types.pop_back(); //Types cannot be assigned, which erase would need
+    }
+    lifeQualityScores.resize(count);
+    economyScores.resize(count);
+    environmentScores.resize(count);
+    prices.resize(count);
+    for (vector<int> &positions : categoryPositions)
+    {
+        positions.erase(lower_bound(positions.begin(), positions.end(), count), positions.end());
+    }
+    lowestScore = 0;
+    highestScore = 0;
+    for (int position = 0; position < count; ++position)
+    {
+        const int lowest = min({lifeQualityScores[position], economyScores[position], environmentScores[position]});
+        const int highest = max({lifeQualityScores[position], economyScores[position], environmentScores[position]});
+        lowestScore = position == 0 ? lowest : min(lowestScore, lowest);
+        highestScore = position == 0 ? highest : max(highestScore, highest);
+    }
+}
+
+int FacilityCatalog::size() const
+{
+    return static_cast<int>(types.size());
+}
+
+bool FacilityCatalog::empty() const
+{
+    return types.empty();
+}
+
+const FacilityType &FacilityCatalog::operator[](int index) const
+{
+    return types[index];
+}
+
+const vector<FacilityType> &FacilityCatalog::getTypes() const
+{
+    return types;
+}
+
+const vector<int> &FacilityCatalog::getPositions(FacilityCategory category) const
+{
+    return categoryPositions[static_cast<int>(category)];
+}
+
+int FacilityCatalog::findMostBalanced(long long lifeQualityScore, long long economyScore, long long environmentScore) const
+{
+    static const BalanceScan scan = chooseBalanceScan();
+    return findMostBalanced(scan, lifeQualityScore, economyScore, environmentScore);
+}
+
+int FacilityCatalog::findMostBalanced(BalanceScan scan, long long lifeQualityScore, long long economyScore, long long environmentScore) const
+{
+    const long long offsets[3] = {lifeQualityScore, economyScore, environmentScore};
+    int narrowed[3];
+    if (!narrowBalanceOffsets(offsets, lowestScore, highestScore, narrowed))
+    {
+        return scanBalanceWide(lifeQualityScores.data(), economyScores.data(), environmentScores.data(), size(), offsets);
+    }
+    return getBalanceScanFunction(scan)(lifeQualityScores.data(), economyScores.data(), environmentScores.data(), size(), narrowed[0], narrowed[1], narrowed[2]);
+}
+
+//Only the types added since the last call are usually left to look at, so this walks the category
+//lists from first instead of scanning and filtering whole columns. Sums are 128-bit: weights stay
+//below 2^62, so no sum of four weighted ints overflows
+int FacilityCatalog::findHighestWeighted(const long long *weights, const bool *allowed, int first, int best) const
+{
+    const auto weightedSum = [&](int position) {
+        return static_cast<__int128>(weights[0]) * lifeQualityScores[position] + static_cast<__int128>(weights[1]) * economyScores[position]
+            + static_cast<__int128>(weights[2]) * environmentScores[position] + static_cast<__int128>(weights[3]) * prices[position];
+    };
+    __int128 bestSum = best >= 0 ? weightedSum(best) : 0;
+    for (int category = 0; category < 3; ++category)
+    {
+        if (!allowed[category])
+        {
+            continue;
+        }
+        const vector<int> &positions = categoryPositions[category];
+        for (auto position = lower_bound(positions.begin(), positions.end(), first); position != positions.end(); ++position)
+        {
+            const __int128 sum = weightedSum(*position);
+            if (best < 0 || sum > bestSum || (sum == bestSum && *position < best))
+            {
+                best = *position;
+                bestSum = sum;
+            }
+        }
+    }
+    return best;
+}
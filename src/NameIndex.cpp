@@ -0,0 +1,71 @@
+#include "NameIndex.h"
+using namespace std;
+
+const size_t INITIAL_SLOTS = 16;
+
+NameIndex::NameIndex() : table()
+{
+    table.write().slots.assign(INITIAL_SLOTS, Slot{0, EMPTY});
+    table.write().used = 0;
+}
+
+void NameIndex::add(string_view name, int position)
+{
+    Table &own = table.write();
+    if (2 * (own.used + 1) > own.slots.size())
+    {
+        vector<Slot> grown(2 * own.slots.size(), Slot{0, EMPTY});
+        for (const Slot &slot : own.slots)
+        {
+            if (slot.position != EMPTY)
+            {
+                insert(grown, slot);
+            }
+        }
+        own.slots.swap(grown);
+    }
+    insert(own.slots, Slot{hashName(name), position});
+    ++own.used;
+}
+
+//Open addressing cannot just empty a slot, so the names kept go into a fresh table of the same size
+void NameIndex::truncate(int size)
+{
+    if (table->used <= static_cast<size_t>(size))
+    {
+        return;
+    }
+    Table &own = table.write();
+    vector<Slot> kept(own.slots.size(), Slot{0, EMPTY});
+    for (const Slot &slot : own.slots)
+    {
+        if (slot.position != EMPTY && slot.position < size)
+        {
+            insert(kept, slot);
+        }
+    }
+    own.slots.swap(kept);
+    own.used = size;
+}
+
+//FNV-1a
+uint64_t NameIndex::hashName(string_view name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : name)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void NameIndex::insert(vector<Slot> &slots, const Slot &slot)
+{
+    size_t i = slot.hash & (slots.size() - 1);
+    while (slots[i].position != EMPTY)
+    {
+        i = (i + 1) & (slots.size() - 1);
+    }
+    slots[i] = slot;
+}
@@ -1,22 +1,28 @@
 
 #include <vector>
+#include <iostream>
+#include <memory>
 #include "Plan.h"
 using std::vector;
 using namespace std;
 
 
 //Constructor
-Plan::Plan(const int planId, const Settlement &settlement, SelectionPolicy *selectionPolicy, const vector<FacilityType> &facilityOptions)
+Plan::Plan(const int planId, const Settlement &settlement, const int settlementId, const SelectionPolicy &selectionPolicy)
     : plan_id(planId),
       settlement(settlement),
-      selectionPolicy(selectionPolicy->clone()),
-      facilityOptions(facilityOptions),
+      settlementId(settlementId),
+      selectionPolicy(selectionPolicy),
       status(PlanStatus::AVALIABLE),
       facilities(),
-      underConstruction(),  
+      facilityRuns(),
+      facilityCount(0),
+      underConstruction(),
+      selected(),
       life_quality_score(0),
       economy_score(0),
-      environment_score(0) {
+      environment_score(0),
+      constructionLimit(1) {
         if (settlement.getType() == SettlementType::VILLAGE)
         {
             constructionLimit = 1;
@@ -32,155 +38,391 @@ Plan::Plan(const int planId, const Settlement &settlement, SelectionPolicy *sele
         }
       }
 
-// might be useful to have a constructor that takes in the scores as well
-Plan::Plan(const int planId, const Settlement &settlement,
-SelectionPolicy *selectionPolicy, const vector<FacilityType> &facilityOptions,
-int LifeScore, int EconomyScore, int EnviromentScore) 
-: plan_id(planId),
-settlement(settlement),
-selectionPolicy(selectionPolicy->clone()),
-status(PlanStatus::AVALIABLE), facilities(), underConstruction(),
-facilityOptions(facilityOptions), life_quality_score(0),
- economy_score(0), environment_score(0){
-
- }
-
-//Copy Constructor
+//Copy Constructor. Facility records are immutable once built, so the copy shares them
 Plan::Plan(const Plan &other)
     : plan_id(other.plan_id),
       settlement(other.settlement),
-      selectionPolicy(other.selectionPolicy->clone()),
-      facilityOptions(other.facilityOptions),
-      facilities(),
-      underConstruction(),  
+      settlementId(other.settlementId),
+      selectionPolicy(other.selectionPolicy),
       status(other.status),
+      facilities(other.facilities),
+      facilityRuns(other.facilityRuns),
+      facilityCount(other.facilityCount),
+      underConstruction(other.underConstruction),
+      selected(other.selected),
       life_quality_score(other.life_quality_score),
       economy_score(other.economy_score),
       environment_score(other.environment_score),
-      constructionLimit(other.constructionLimit)
-{
-    for (const auto facility : other.facilities)
-    {
-        facilities.push_back(facility->clone());
-    }
-
-    for (const auto facility : other.underConstruction)
-    {
-        underConstruction.push_back(facility->clone());
-    }
-}
+      constructionLimit(other.constructionLimit) {}
 
 //Move Constructor
 Plan::Plan(Plan &&other) noexcept
     : plan_id(other.plan_id),
       settlement(other.settlement),
+      settlementId(other.settlementId),
       selectionPolicy(other.selectionPolicy),
-      facilityOptions(move(other.facilityOptions)),
       status(other.status),
       facilities(move(other.facilities)),
-      underConstruction(move(other.underConstruction)),
+      facilityRuns(move(other.facilityRuns)),
+      facilityCount(other.facilityCount),
+      underConstruction(other.underConstruction),
+      selected(other.selected),
       life_quality_score(other.life_quality_score),
       economy_score(other.economy_score),
       environment_score(other.environment_score),
       constructionLimit(other.constructionLimit)
 {
-    other.facilities.clear();
+    other.facilityRuns.clear();
+    other.facilityCount = 0;
     other.underConstruction.clear();
-    other.selectionPolicy = nullptr;
 }
 
-//Destructor
-Plan::~Plan()
+
+//Getters
+const long long Plan::getlifeQualityScore() const
+{
+    return life_quality_score;
+}
+
+const long long Plan::getEconomyScore() const
 {
-     for (auto &facility : facilities)
+    return economy_score;
+}
+
+const long long Plan::getEnvironmentScore() const
+{
+    return environment_score;
+}
+
+const int Plan::getPlanId() const
+{
+    return plan_id;
+}
+
+PlanStatus Plan::getPlanStatus() const
+{
+    return status;
+}
+
+const Settlement &Plan::getSettlement() const
+{
+    return settlement;
+}
+
+const ChunkedVector<Facility> &Plan::getFacilities() const
+{
+    return facilities;
+}
+
+const vector<FacilityRun> &Plan::getFacilityRuns() const
+{
+    return facilityRuns;
+}
+
+long long Plan::getFacilityCount() const
+{
+    return facilityCount;
+}
+
+const FixedVector<int, MAX_CONSTRUCTION_LIMIT> &Plan::getUnderConstruction() const
+{
+    return underConstruction;
+}
+
+const SelectionPolicy &Plan::getSelectionPolicy() const
+{
+    return selectionPolicy;
+}
+
+void Plan::setSelectionPolicy(const SelectionPolicy &selectionPolicy)
+{
+    this->selectionPolicy = selectionPolicy;
+}
+
+//Picks facilities for the free construction slots. Touches only this plan and the read-only
+//facility options, so Simulation may run it for many plans at once
+int Plan::selectFacilities(const FacilityCatalog &facilityOptions)
+{
+    const int freeSlots = constructionLimit - underConstruction.size() - selected.size();
+    if (status != PlanStatus::AVALIABLE || facilityOptions.empty() || freeSlots <= 0)
+    {
+        return 0;
+    }
+    int positions[MAX_CONSTRUCTION_LIMIT];
+    selectionPolicy.selectFacilities(facilityOptions, freeSlots, positions);
+    for (int i = 0; i < freeSlots; ++i)
     {
-        delete facility;
-        facility = nullptr;
+        selected.push_back(positions[i]);
     }
+    return freeSlots;
+}
 
-    for (auto facility : underConstruction)
+bool Plan::canSelect(const FacilityCatalog &facilityOptions) const
+{
+    const int freeSlots = constructionLimit - underConstruction.size() - selected.size();
+    if (status != PlanStatus::AVALIABLE || facilityOptions.empty() || freeSlots <= 0)
     {
-        delete facility;
-        facility = nullptr;
+        return true;
     }
+    return selectionPolicy.canSelect(facilityOptions);
+}
 
-    if (selectionPolicy)
+//Starts building the selected facilities on this tick
+void Plan::step(ConstructionTable &constructions, const vector<FacilityType> &facilityOptions, long long tick)
+{
+    for (int facilityIndex : selected)
     {
-        delete selectionPolicy;
-        selectionPolicy = nullptr;
+        underConstruction.push_back(constructions.add(plan_id, facilityIndex, facilityOptions[facilityIndex], tick));
     }
+    selected.clear();
+
+    setPlanStatus();
 }
 
+//Turns the rows finished by this tick into operational facilities. Slots are visited in order and
+//the last slot is swapped into each finished one, which fixes the order facilities are listed in.
+//The finished rows are handed back so the caller can drop them from the table
+void Plan::collectCompleted(const ConstructionTable &constructions, long long tick, FixedVector<int, MAX_CONSTRUCTION_LIMIT> &finishedRows)
+{
+    int i = 0;
+    while (i < underConstruction.size())
+    {
+        const int row = underConstruction[i];
+        if (!constructions.isCompleted(row, tick))
+        {
+            ++i;
+            continue;
+        }
 
-//Getters
-const int Plan::getlifeQualityScore() const
+        Facility facility(constructions.getFacilityIndex(row), settlementId, 0);
+        facility.setStatus(FacilityStatus::OPERATIONAL);
+        addFacility(facility);
+        life_quality_score += constructions.getLifeQualityDelta(row);
+        economy_score += constructions.getEconomyDelta(row);
+        environment_score += constructions.getEnvironmentDelta(row);
+        finishedRows.push_back(row);
+        underConstruction[i] = underConstruction.back();
+        underConstruction.pop_back();
+    }
+
+    setPlanStatus();
+}
+
+void Plan::relocateConstruction(int fromRow, int toRow)
 {
-    return life_quality_score;
+    for (int &row : underConstruction)
+    {
+        if (row == fromRow)
+        {
+            row = toRow;
+            return;
+        }
+    }
 }
 
-const int Plan::getEconomyScore() const
+//The state that decides everything this plan does from this tick on: its policy and what is left
+//of each construction, slot by slot. False while picks are pending, which never repeats
+bool Plan::getCycleKey(const ConstructionTable &constructions, long long tick, vector<long long> &key) const
 {
-    return economy_score;
+    key.clear();
+    if (!selected.empty())
+    {
+        return false;
+    }
+
+    selectionPolicy.appendCycleKey(key);
+    for (int row : underConstruction)
+    {
+        key.push_back(constructions.getFacilityIndex(row));
+        key.push_back(constructions.getFinishTick(row) - tick);
+    }
+    return true;
 }
 
-const int Plan::getEnvironmentScore() const
+CycleDetector::Mark Plan::getCycleMark(long long tick) const
 {
-    return environment_score;
+    CycleDetector::Mark mark{tick, static_cast<int>(facilities.size()), life_quality_score, economy_score, environment_score, {}};
+    selectionPolicy.appendRunningTotals(mark.policyTotals);
+    return mark;
 }
 
-const vector<Facility *> &Plan::getFacilities() const
+//Applies `periods` more repetitions of what happened since start, as if this plan had stepped
+//through them: scores and policy totals grow, the facilities built since start are listed again
+//and every construction finishes that much later. False if the facilities since start are not
+//the tail of a plain run, in which case nothing is changed
+bool Plan::skipCycles(const CycleDetector::Mark &start, long long tick, long long periods, ConstructionTable &constructions)
 {
-    return facilities;
+    const int first = start.facilityRecords;
+    const int last = static_cast<int>(facilities.size());
+    if (first == last || facilityRuns.empty() || facilityRuns.back().repeat != 1 || facilityRuns.back().first > first)
+    {
+        return false;
+    }
+
+    facilityRuns.push_back(FacilityRun{first, last, periods});
+    facilityCount += (last - first) * periods;
+    life_quality_score += (life_quality_score - start.lifeQualityScore) * periods;
+    economy_score += (economy_score - start.economyScore) * periods;
+    environment_score += (environment_score - start.environmentScore) * periods;
+
+    vector<long long> totals;
+    selectionPolicy.appendRunningTotals(totals);
+    for (size_t i = 0; i < totals.size(); ++i)
+    {
+        totals[i] -= start.policyTotals[i];
+    }
+    selectionPolicy.addRunningTotals(totals, periods);
+
+    const long long delay = (tick - start.tick) * periods;
+    for (int row : underConstruction)
+    {
+        constructions.delay(row, delay);
+    }
+    return true;
 }
 
-const SelectionPolicy *Plan::getSelectionPolicy() const
+Plan::UndoState Plan::getUndoState() const
 {
-    return selectionPolicy;
+    const FacilityRun lastRun = facilityRuns.empty() ? FacilityRun{0, 0, 0} : facilityRuns.back();
+    return UndoState{selectionPolicy, status, facilities.size(), static_cast<int>(facilityRuns.size()), lastRun, facilityCount, underConstruction, selected,
+        life_quality_score, economy_score, environment_score};
 }
 
-void Plan::setSelectionPolicy(SelectionPolicy *selectionPolicy)
+void Plan::restore(const UndoState &state)
 {
-    if (!(selectionPolicy == this->selectionPolicy))
-        if (this->selectionPolicy)
-        {
-            delete this->selectionPolicy;
-        }
+    selectionPolicy = state.selectionPolicy;
+    status = state.status;
+    while (facilities.size() > state.facilityRecords)
+    {
+        facilities.pop_back();
+    }
+    facilityRuns.resize(state.facilityRunCount);
+    if (!facilityRuns.empty())
+    {
+        facilityRuns.back() = state.lastRun;
+    }
+    facilityCount = state.facilityCount;
+    underConstruction = state.underConstruction;
+    selected = state.selected;
+    life_quality_score = state.lifeQualityScore;
+    economy_score = state.economyScore;
+    environment_score = state.environmentScore;
+}
 
-        {
-            this->selectionPolicy = selectionPolciy ? selectionPolicy->clone() : nullptr;
-        }
+void Plan::save(SnapshotWriter &writer) const
+{
+    writer.writeI32(plan_id);
+    writer.writeI32(settlementId);
+    selectionPolicy.save(writer);
+    writer.writeU8(static_cast<uint8_t>(status));
+    writer.writeI64(life_quality_score);
+    writer.writeI64(economy_score);
+    writer.writeI64(environment_score);
+
+    writer.writeI32(facilities.size());
+    for (int i = 0; i < facilities.size(); ++i)
+    {
+        writer.writeI32(facilities[i].getFacilityId());
+        writer.writeI32(facilities[i].getTimeLeft());
+        writer.writeU8(static_cast<uint8_t>(facilities[i].getStatus()));
+    }
+    writer.writeI32(static_cast<int32_t>(facilityRuns.size()));
+    for (const FacilityRun &run : facilityRuns)
+    {
+        writer.writeI32(run.first);
+        writer.writeI32(run.last);
+        writer.writeI64(run.repeat);
+    }
+
+    writer.writeI32(underConstruction.size());
+    for (int row : underConstruction)
+    {
+        writer.writeI32(row);
+    }
+    writer.writeI32(selected.size());
+    for (int facilityIndex : selected)
+    {
+        writer.writeI32(facilityIndex);
+    }
 }
 
-void Plan::step()
+//Reads a plan written by save. Everything it refers to (settlement, facility options, policy
+//definitions, construction rows) is loaded before plans and checked here
+shared_ptr<Plan> Plan::load(SnapshotReader &reader, const ChunkedVector<shared_ptr<Settlement>> &settlements, const FacilityCatalog &facilityOptions, const vector<shared_ptr<const WeightedPolicy>> &policyDefinitions, const ConstructionTable &constructions)
 {
-    if (status == PlanStatus::AVALIABLE)
+    const int planId = reader.readI32();
+    const int settlementId = reader.readI32();
+    if (settlementId < 0 || settlementId >= settlements.size())
+    {
+        reader.fail("bad settlement id");
+    }
+    const SelectionPolicy policy = SelectionPolicy::load(reader, facilityOptions, policyDefinitions);
+    shared_ptr<Plan> plan = make_shared<Plan>(planId, *settlements[settlementId], settlementId, policy);
+
+    const uint8_t status = reader.readU8();
+    if (status > static_cast<uint8_t>(PlanStatus::BUSY))
     {
-        while (underConstruction.size() < constructionLimit)
+        reader.fail("bad plan status");
+    }
+    plan->status = static_cast<PlanStatus>(status);
+    plan->life_quality_score = reader.readI64();
+    plan->economy_score = reader.readI64();
+    plan->environment_score = reader.readI64();
+
+    const int facilityOptionCount = facilityOptions.size();
+    const int records = reader.readCount(INT32_MAX, 2 * sizeof(int32_t) + sizeof(uint8_t));
+    for (int i = 0; i < records; ++i)
+    {
+        const int facilityId = reader.readI32();
+        Facility facility(facilityId, settlementId, reader.readI32());
+        const uint8_t facilityStatus = reader.readU8();
+        if (facilityId < 0 || facilityId >= facilityOptionCount || facilityStatus > static_cast<uint8_t>(FacilityStatus::OPERATIONAL))
         {
-            FacilityType facilityType = selectionPolicy->selectFacility(facilityOptions, life_quality_score, economy_score, environment_score);
-            Facility *facility = new Facility(facilityType, settlement.getName());
-            underConstruction.push_back(facility);
+            reader.fail("bad facility record");
         }
-        
+        facility.setStatus(static_cast<FacilityStatus>(facilityStatus));
+        plan->facilities.push_back(facility);
     }
-    
-    for (size_t i = 0; i < underConstruction.size(); ++i)
+    const int runs = reader.readCount(records, 2 * sizeof(int32_t) + sizeof(int64_t));
+    for (int i = 0; i < runs; ++i)
     {
-        Facility *currFacility = underConstruction[i];
-        currFacility->step();
+        FacilityRun run;
+        run.first = reader.readI32();
+        run.last = reader.readI32();
+        run.repeat = reader.readI64();
+        if (run.first < 0 || run.first >= run.last || run.last > records || run.repeat < 1)
+        {
+            reader.fail("bad facility run");
+        }
+        plan->facilityRuns.push_back(run);
+        plan->facilityCount += (run.last - run.first) * run.repeat;
+    }
 
-        if (currFacility->getStatus() == FacilityStatus::OPERATIONAL)
+    const int building = reader.readCount(plan->constructionLimit);
+    for (int i = 0; i < building; ++i)
+    {
+        const int row = reader.readI32();
+        if (row < 0 || row >= constructions.size() || constructions.getPlanId(row) != planId)
         {
-            addFacility(currFacility);
-            life_quality_score += currFacility->getLifeQualityScore();
-            economy_score += currFacility->getEconomyScore();
-            environment_score += currFacility->getEnvironmentScore();
-            underConstruction[i] = underConstruction.back();
-            underConstruction.pop_back();
-            i--;
+            reader.fail("bad construction slot");
         }
+        plan->underConstruction.push_back(row);
     }
+    const int picked = reader.readCount(plan->constructionLimit - building);
+    for (int i = 0; i < picked; ++i)
+    {
+        const int facilityIndex = reader.readI32();
+        if (facilityIndex < 0 || facilityIndex >= facilityOptionCount)
+        {
+            reader.fail("bad selected facility");
+        }
+        plan->selected.push_back(facilityIndex);
+    }
+    return plan;
+}
 
+void Plan::setPlanStatus()
+{
     if (underConstruction.size() == constructionLimit)
     {
         status = PlanStatus::BUSY;
@@ -189,58 +431,76 @@ void Plan::step()
     {
         status = PlanStatus::AVALIABLE;
     }
+}
 
-void Plan::printStatus()
+void Plan::printStatus(const vector<FacilityType> &facilityOptions) const
 {
-    cout << toString() << endl;
+    TextWriter out(cout.rdbuf());
+    render(out, facilityOptions);
+    out << '\n';
 }
 
 
-void Plan::addFacility(Facility *facility)
+void Plan::addFacility(const Facility &facility)
 {
-        facilities.push_back(facility);
+    const int index = static_cast<int>(facilities.size());
+    facilities.push_back(facility);
+    ++facilityCount;
+    if (!facilityRuns.empty() && facilityRuns.back().repeat == 1 && facilityRuns.back().last == index)
+    {
+        ++facilityRuns.back().last;
+    }
+    else
+    {
+        facilityRuns.push_back(FacilityRun{index, index + 1, 1});
+    }
 }
 
-const string Plan::toString() const {
-    ostringstream oss;
+const string Plan::toString(const vector<FacilityType> &facilityOptions) const {
+    string text;
+    TextWriter out(text);
+    render(out, facilityOptions);
+    out.flush();
+    return text;
+}
 
-    oss << "PlanID: " << plan_id << "\n";
-    oss << "SettlementName: " << settlement << "\n";
+void Plan::render(TextWriter &out, const vector<FacilityType> &facilityOptions) const {
+    out << "PlanID: " << plan_id << '\n';
+    out << "SettlementName: " << settlement.getName() << '\n';
 
-    oss << "PlanStatus: ";
+    out << "PlanStatus: ";
     switch (status) {
     case PlanStatus::BUSY:
-        oss << "BUSY";
+        out << "BUSY";
         break;
     case PlanStatus::AVALIABLE:
-        oss << "AVALIABLE";
+        out << "AVALIABLE";
         break;
     }
-    oss << "\n";
-
-    if (selectionPolicy) {
-        oss << "SelectionPolicy: " << selectionPolicy->toString() << "\n";
-    }
-
-    oss << "LifeQualityScore: " << life_quality_score << "\n";
-    oss << "EconomyScore: " << economy_score << "\n";
-    oss << "EnvironmentScore: " << environment_score << "\n";
-
-    for (const auto &facility : facilities) {
-        oss << "FacilityName: " << facility->getName() << "\n";
-        oss << "FacilityStatus: ";
-        switch (facility->getStatus()) {
-        case FacilityStatus::UNDER_CONSTRUCTION:
-            oss << "UNDER_CONSTRUCTION";
-            break;
-        case FacilityStatus::OPERATIONAL:
-            oss << "OPERATIONAL";
-            break;
+    out << '\n';
+
+    out << "SelectionPolicy: " << selectionPolicy.toString() << '\n';
+
+    out << "LifeQualityScore: " << life_quality_score << '\n';
+    out << "EconomyScore: " << economy_score << '\n';
+    out << "EnvironmentScore: " << environment_score << '\n';
+
+    for (const FacilityRun &run : facilityRuns) {
+        for (long long repeat = 0; repeat < run.repeat; ++repeat) {
+            for (int i = run.first; i < run.last; ++i) {
+                const Facility &facility = facilities[i];
+                out << "FacilityName: " << facility.getName(facilityOptions) << '\n';
+                out << "FacilityStatus: ";
+                switch (facility.getStatus()) {
+                case FacilityStatus::UNDER_CONSTRUCTIONS:
+                    out << "UNDER_CONSTRUCTION";
+                    break;
+                case FacilityStatus::OPERATIONAL:
+                    out << "OPERATIONAL";
+                    break;
+                }
+                out << '\n';
+            }
         }
-        oss << "\n";
     }
-
-    return oss.str();
 }
-
-
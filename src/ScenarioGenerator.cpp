@@ -0,0 +1,167 @@
+#include "ScenarioGenerator.h"
+#include <stdexcept>
+#include <vector>
+using namespace std;
+
+static const char *const POLICY_NAMES[] = {"nve", "bal", "eco", "env"};
+
+//Kinds of random items, so that adding settlements does not change the facilities
+enum RandomKind : uint64_t
+{
+    SETTLEMENT_TYPE = 1,
+    FACILITY = 2,
+    PLAN_POLICY = 3,
+    SCRIPT = 4,
+};
+
+//splitmix64's finalizer: spreads any change in value over all 64 bits
+static uint64_t mixBits(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+//An index into weights, each index weights[index] times as likely as a weight of 1
+static int pickWeighted(const int *weights, int count, uint64_t random)
+{
+    long long total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        total += weights[i];
+    }
+    long long left = static_cast<long long>(random % static_cast<uint64_t>(total));
+    for (int i = 0; i < count; ++i)
+    {
+        if (left < weights[i])
+        {
+            return i;
+        }
+        left -= weights[i];
+    }
+    return count - 1;
+}
+
+static bool validMix(const int *weights, int count)
+{
+    long long total = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (weights[i] < 0)
+        {
+            return false;
+        }
+        total += weights[i];
+    }
+    return total > 0;
+}
+
+static void writeFacility(TextWriter &out, const FacilityType &facility)
+{
+    out << "facility " << facility.getName() << ' ' << static_cast<int>(facility.getCategory()) << ' ' << facility.getCost() << ' '
+        << facility.getLifeQualityScore() << ' ' << facility.getEconomyScore() << ' ' << facility.getEnvironmentScore() << '\n';
+}
+
+// ScenarioGenerator
+ScenarioGenerator::ScenarioGenerator(const ScenarioSettings &settings) : settings(settings)
+{
+    if (settings.settlements < 0 || settings.facilities < 0 || settings.plans < 0 || settings.steps < 0)
+    {
+        throw runtime_error("counts cannot be negative");
+    }
+    if (settings.plans > 0 && settings.settlements == 0)
+    {
+        throw runtime_error("plans need a settlement");
+    }
+    if (!validMix(settings.settlementMix, 3) || !validMix(settings.categoryMix, 3) || !validMix(settings.policyMix, 4))
+    {
+        throw runtime_error("a mix needs non-negative weights that are not all 0");
+    }
+    if (settings.minTicks < 1 || settings.maxTicks < settings.minTicks)
+    {
+        throw runtime_error("ticks must be a range of positive counts");
+    }
+    if (settings.actionPercent < 0 || settings.actionPercent > 100)
+    {
+        throw runtime_error("the action percentage must be between 0 and 100");
+    }
+}
+
+uint64_t ScenarioGenerator::random(uint64_t kind, uint64_t index) const
+{
+    return mixBits(mixBits(settings.seed ^ (kind << 56)) + index);
+}
+
+FacilityType ScenarioGenerator::makeFacility(int index) const
+{
+    uint64_t bits = random(FACILITY, index);
+    const FacilityCategory category = static_cast<FacilityCategory>(pickWeighted(settings.categoryMix, 3, bits));
+    //The rest from the upper bits, which pickWeighted's modulo barely touched
+    bits >>= 32;
+    const int price = 1 + bits % 5;
+    const int lifeQuality = (bits / 5) % 6;
+    const int economy = (bits / 30) % 6;
+    const int environment = (bits / 180) % 6;
+    return FacilityType("f" + to_string(index), category, price, lifeQuality, economy, environment);
+}
+
+void ScenarioGenerator::writeConfig(TextWriter &out) const
+{
+    for (int i = 0; i < settings.settlements; ++i)
+    {
+        out << "settlement s" << i << ' ' << pickWeighted(settings.settlementMix, 3, random(SETTLEMENT_TYPE, i)) << '\n';
+    }
+    for (int i = 0; i < settings.facilities; ++i)
+    {
+        writeFacility(out, makeFacility(i));
+    }
+    for (int i = 0; i < settings.plans; ++i)
+    {
+        out << "plan s" << i % settings.settlements << ' ' << POLICY_NAMES[pickWeighted(settings.policyMix, 4, random(PLAN_POLICY, i))] << '\n';
+    }
+}
+
+void ScenarioGenerator::writeScript(TextWriter &out) const
+{
+    vector<int> policies; //Of every plan, to change each to a policy it does not have
+    policies.reserve(settings.plans);
+    for (int i = 0; i < settings.plans; ++i)
+    {
+        policies.push_back(pickWeighted(settings.policyMix, 4, random(PLAN_POLICY, i)));
+    }
+    int settlements = settings.settlements;
+    int facilities = settings.facilities;
+    uint64_t draws = 0;
+    for (int i = 0; i < settings.steps; ++i)
+    {
+        if (random(SCRIPT, draws++) % 100 < static_cast<uint64_t>(settings.actionPercent))
+        {
+            const int action = random(SCRIPT, draws++) % 4;
+            const uint64_t bits = random(SCRIPT, draws++);
+            if (action == 0 && !policies.empty())
+            {
+                out << "planStatus " << static_cast<int>(bits % policies.size()) << '\n';
+            }
+            else if (action == 1 && !policies.empty())
+            {
+                const int planId = bits % policies.size();
+                policies[planId] = (policies[planId] + 1 + (bits >> 32) % 3) % 4;
+                out << "changePolicy " << planId << ' ' << POLICY_NAMES[policies[planId]] << '\n';
+            }
+            else if (action == 2)
+            {
+                writeFacility(out, makeFacility(facilities++));
+            }
+            else
+            {
+                const int policy = pickWeighted(settings.policyMix, 4, bits >> 8);
+                out << "settlement s" << settlements << ' ' << pickWeighted(settings.settlementMix, 3, bits) << '\n';
+                out << "plan s" << settlements++ << ' ' << POLICY_NAMES[policy] << '\n';
+                policies.push_back(policy);
+            }
+        }
+        const int ticks = settings.minTicks + random(SCRIPT, draws++) % (settings.maxTicks - settings.minTicks + 1);
+        out << "step " << ticks << '\n';
+    }
+    out << "close\n";
+}
@@ -1,21 +1,73 @@
 
 #include "SelectionPolicy.h"
 #include <algorithm>
-#include <climits>
+#include <stdexcept>
 using std::vector;
 using namespace std;
 
+// PolicyDefaults
+bool PolicyDefaults::canSelect(const FacilityCatalog &facilitiesOptions) const
+{
+    return true;
+}
+
+void PolicyDefaults::appendRunningTotals(vector<long long> &totals) const
+{
+}
+
+void PolicyDefaults::addRunningTotals(const vector<long long> &delta, long long times)
+{
+}
+
+//Tags written ahead of each policy's state in snapshots
+enum class PolicyTag : uint8_t
+{
+    NAIVE,
+    BALANCED,
+    ECONOMY,
+    SUSTAINABILITY,
+    WEIGHTED,
+};
+
+// Round robin over the types of one category. lastSelectedIndex is where the walk over the whole
+// catalog resumes and cursor the matching entry in the category's positions, so a pick reads that
+// entry instead of stepping past the other categories. The cursor is only trusted while it agrees
+// with lastSelectedIndex; otherwise (a loaded policy, a first pick) it is found again by bisection
+static int selectInCategory(const vector<int> &positions, int catalogSize, int &lastSelectedIndex, int &cursor)
+{
+    const int count = static_cast<int>(positions.size());
+    const bool agrees = cursor >= 0 && cursor <= count && (cursor == count || positions[cursor] >= lastSelectedIndex) && (cursor == 0 || positions[cursor - 1] < lastSelectedIndex);
+    if (!agrees)
+    {
+        cursor = static_cast<int>(lower_bound(positions.begin(), positions.end(), lastSelectedIndex) - positions.begin());
+    }
+    if (cursor == count)
+    {
+        cursor = 0; //Nothing left before the end of the catalog; the walk wraps around
+    }
+
+    const int position = positions[cursor++];
+    lastSelectedIndex = (position + 1) % catalogSize;
+    if (lastSelectedIndex == 0)
+    {
+        cursor = 0;
+    }
+    return position;
+}
+
 // NaiveSelection
-NaiveSelection::NaiveSelection()
-    : lastSelectedIndex(0)
+NaiveSelection::NaiveSelection(int lastSelectedIndex)
+    : lastSelectedIndex(lastSelectedIndex)
 {
 }
 
-const FacilityType &NaiveSelection::selectFacility(const vector<FacilityType> &facilitiesOptions)
+void NaiveSelection::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
 {
-    const FacilityType &selectedFacility = facilitiesOptions[lastSelectedIndex];
-    lastSelectedIndex = (lastSelectedIndex + 1) % facilitiesOptions.size();
-    return selectedFacility;
+    for (int i = 0; i < count; ++i)
+    {
+        positions[i] = lastSelectedIndex;
+        lastSelectedIndex = (lastSelectedIndex + 1) % facilitiesOptions.size();
+    }
 }
 
 const string NaiveSelection::toString() const
@@ -23,39 +75,32 @@ const string NaiveSelection::toString() const
     return "nve";
 }
 
-NaiveSelection *NaiveSelection::clone() const
+void NaiveSelection::appendCycleKey(vector<long long> &key) const
+{
+    key.push_back(lastSelectedIndex);
+}
+
+void NaiveSelection::save(SnapshotWriter &writer) const
 {
-    return new NaiveSelection(*this);
+    writer.writeU8(static_cast<uint8_t>(PolicyTag::NAIVE));
+    writer.writeI32(lastSelectedIndex);
 }
 
 // BalancedSelection
-BalancedSelection::BalancedSelection(int LifeQualityScore, int EconomyScore, int EnvironmentScore)
+BalancedSelection::BalancedSelection(long long LifeQualityScore, long long EconomyScore, long long EnvironmentScore)
     : LifeQualityScore(LifeQualityScore), EconomyScore(EconomyScore), EnvironmentScore(EnvironmentScore) {}
 
-const FacilityType &BalancedSelection::selectFacility(const vector<FacilityType> &facilitiesOptions)
+void BalancedSelection::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
 {
-
-
-    const FacilityType *bestFacility = &facilitiesOptions[0];
-    int bestBalance = INT_MAX;
-    for (const FacilityType &curr : facilitiesOptions)
+    // The scores keep running so each pick balances against the ones before it as well
+    for (int i = 0; i < count; ++i)
     {
-        int possibleLifeQualityScore = curr.getLifeQualityScore() + this->LifeQualityScore;
-        int possibleEconomyScore = curr.getEconomyScore() + this->EconomyScore;
-        int possibleEnvironmentScore = curr.getEnvironmentScore() + this->EnvironmentScore;
-
-        int maxScore = max({possibleLifeQualityScore, possibleEnvironmentScore, possibleEconomyScore});
-        int minScore = min({possibleLifeQualityScore, possibleEnvironmentScore, possibleEconomyScore});
-        int balance = maxScore - minScore;
-
-        if (balance < bestBalance)
-        {
-            bestBalance = balance;
-            bestFacility = &curr;
-        }
+        positions[i] = facilitiesOptions.findMostBalanced(LifeQualityScore, EconomyScore, EnvironmentScore);
+        const FacilityType &bestFacility = facilitiesOptions[positions[i]];
+        LifeQualityScore += bestFacility.getLifeQualityScore();
+        EconomyScore += bestFacility.getEconomyScore();
+        EnvironmentScore += bestFacility.getEnvironmentScore();
     }
-
-    return *bestFacility;
 }
 
 const string BalancedSelection::toString() const
@@ -63,27 +108,51 @@ const string BalancedSelection::toString() const
     return "bal";
 }
 
-BalancedSelection *BalancedSelection::clone() const
+// Picks only compare the scores with each other, so only their differences matter
+void BalancedSelection::appendCycleKey(vector<long long> &key) const
 {
-    return new BalancedSelection(*this);
+    key.push_back(EconomyScore - LifeQualityScore);
+    key.push_back(EnvironmentScore - LifeQualityScore);
 }
 
-// EconomySelection
+void BalancedSelection::appendRunningTotals(vector<long long> &totals) const
+{
+    totals.push_back(LifeQualityScore);
+    totals.push_back(EconomyScore);
+    totals.push_back(EnvironmentScore);
+}
 
-EconomySelection::EconomySelection()
-    : lastSelectedIndex(0) {}
+void BalancedSelection::addRunningTotals(const vector<long long> &delta, long long times)
+{
+    LifeQualityScore += delta[0] * times;
+    EconomyScore += delta[1] * times;
+    EnvironmentScore += delta[2] * times;
+}
 
-const FacilityType &EconomySelection::selectFacility(const std::vector<FacilityType> &facilitiesOptions)
+void BalancedSelection::save(SnapshotWriter &writer) const
 {
-    size_t startIndex = lastSelectedIndex;
- 
-        const FacilityType &selectedFacility = facilitiesOptions[lastSelectedIndex];
-        lastSelectedIndex = (lastSelectedIndex + 1) % facilitiesOptions.size();
+    writer.writeU8(static_cast<uint8_t>(PolicyTag::BALANCED));
+    writer.writeI64(LifeQualityScore);
+    writer.writeI64(EconomyScore);
+    writer.writeI64(EnvironmentScore);
+}
 
-        if (selectedFacility.getCategory() == FacilityCategory::ECONOMY)
-        {
-            return selectedFacility;
-        }
+// EconomySelection
+
+EconomySelection::EconomySelection(int lastSelectedIndex)
+    : lastSelectedIndex(lastSelectedIndex), cursor(-1) {}
+
+void EconomySelection::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
+{
+    const vector<int> &categoryPositions = facilitiesOptions.getPositions(FacilityCategory::ECONOMY);
+    if (categoryPositions.empty())
+    {
+        throw runtime_error("No economy facility available");
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        positions[i] = selectInCategory(categoryPositions, facilitiesOptions.size(), lastSelectedIndex, cursor);
+    }
 }
 
 const string EconomySelection::toString() const
@@ -91,27 +160,37 @@ const string EconomySelection::toString() const
     return "eco";
 }
 
-EconomySelection *EconomySelection::clone() const
+bool EconomySelection::canSelect(const FacilityCatalog &facilitiesOptions) const
 {
-    return new EconomySelection(*this);
+    return !facilitiesOptions.getPositions(FacilityCategory::ECONOMY).empty();
 }
 
-// SustainabiltiySelection
-SustainabilitySelection::SustainabilitySelection()
-    : lastSelectedIndex(0) {}
+void EconomySelection::appendCycleKey(vector<long long> &key) const
+{
+    key.push_back(lastSelectedIndex);
+}
 
-const FacilityType &SustainabilitySelection::selectFacility(const std::vector<FacilityType> &facilitiesOptions)
+void EconomySelection::save(SnapshotWriter &writer) const
 {
+    writer.writeU8(static_cast<uint8_t>(PolicyTag::ECONOMY));
+    writer.writeI32(lastSelectedIndex);
+}
 
-    size_t startIndex = lastSelectedIndex;
-        const FacilityType &selectedFacility = facilitiesOptions[lastSelectedIndex];
-        lastSelectedIndex = (lastSelectedIndex + 1) % facilitiesOptions.size();
+// SustainabiltiySelection
+SustainabilitySelection::SustainabilitySelection(int lastSelectedIndex)
+    : lastSelectedIndex(lastSelectedIndex), cursor(-1) {}
 
-        if (selectedFacility.getCategory() == FacilityCategory::ENVIRONMENT)
-        {
-            return selectedFacility;
-        }
-   
+void SustainabilitySelection::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
+{
+    const vector<int> &categoryPositions = facilitiesOptions.getPositions(FacilityCategory::ENVIRONMENT);
+    if (categoryPositions.empty())
+    {
+        throw runtime_error("No environment facility available");
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        positions[i] = selectInCategory(categoryPositions, facilitiesOptions.size(), lastSelectedIndex, cursor);
+    }
 }
 
 const string SustainabilitySelection::toString() const
@@ -119,7 +198,200 @@ const string SustainabilitySelection::toString() const
     return "env";
 }
 
-SustainabilitySelection *SustainabilitySelection::clone() const
+bool SustainabilitySelection::canSelect(const FacilityCatalog &facilitiesOptions) const
+{
+    return !facilitiesOptions.getPositions(FacilityCategory::ENVIRONMENT).empty();
+}
+
+void SustainabilitySelection::appendCycleKey(vector<long long> &key) const
+{
+    key.push_back(lastSelectedIndex);
+}
+
+void SustainabilitySelection::save(SnapshotWriter &writer) const
 {
-    return new SustainabilitySelection(*this);
+    writer.writeU8(static_cast<uint8_t>(PolicyTag::SUSTAINABILITY));
+    writer.writeI32(lastSelectedIndex);
+}
+
+// WeightedSelection
+WeightedSelection::WeightedSelection(shared_ptr<const WeightedPolicy> definition)
+    : definition(move(definition)), scanned(0), best(-1) {}
+
+//Options are only ever appended, so the ones scored stay as they were; a smaller catalog means a
+//different one and everything is scored again
+void WeightedSelection::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
+{
+    if (scanned > facilitiesOptions.size())
+    {
+        scanned = 0;
+        best = -1;
+    }
+    if (scanned < facilitiesOptions.size())
+    {
+        best = definition->findBest(facilitiesOptions, scanned, best);
+        scanned = facilitiesOptions.size();
+    }
+    if (best < 0)
+    {
+        throw runtime_error("No facility available for policy " + definition->getName());
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        positions[i] = best;
+    }
+}
+
+const string WeightedSelection::toString() const
+{
+    return definition->getName();
+}
+
+bool WeightedSelection::canSelect(const FacilityCatalog &facilitiesOptions) const
+{
+    return definition->canSelect(facilitiesOptions);
+}
+
+//The options do not change during a step, and neither does the pick
+void WeightedSelection::appendCycleKey(vector<long long> &key) const
+{
+    key.push_back(best);
+}
+
+void WeightedSelection::save(SnapshotWriter &writer) const
+{
+    writer.writeU8(static_cast<uint8_t>(PolicyTag::WEIGHTED));
+    writer.writeString(definition->getName());
+}
+
+// SelectionPolicy
+SelectionPolicy::SelectionPolicy() : policy() {}
+
+SelectionPolicy::SelectionPolicy(const NaiveSelection &policy) : policy(policy) {}
+
+SelectionPolicy::SelectionPolicy(const BalancedSelection &policy) : policy(policy) {}
+
+SelectionPolicy::SelectionPolicy(const EconomySelection &policy) : policy(policy) {}
+
+SelectionPolicy::SelectionPolicy(const SustainabilitySelection &policy) : policy(policy) {}
+
+SelectionPolicy::SelectionPolicy(const WeightedSelection &policy) : policy(policy) {}
+
+bool SelectionPolicy::create(string_view name, long long lifeQualityScore, long long economyScore, long long environmentScore, SelectionPolicy &created)
+{
+    if (name == "nve")
+    {
+        created = NaiveSelection();
+    }
+    else if (name == "bal")
+    {
+        created = BalancedSelection(lifeQualityScore, economyScore, environmentScore);
+    }
+    else if (name == "eco")
+    {
+        created = EconomySelection();
+    }
+    else if (name == "env")
+    {
+        created = SustainabilitySelection();
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+void SelectionPolicy::selectFacilities(const FacilityCatalog &facilitiesOptions, int count, int *positions)
+{
+    visit([&](auto &policy) { policy.selectFacilities(facilitiesOptions, count, positions); }, policy);
+}
+
+const FacilityType &SelectionPolicy::selectFacility(const FacilityCatalog &facilitiesOptions)
+{
+    int position;
+    selectFacilities(facilitiesOptions, 1, &position);
+    return facilitiesOptions[position];
+}
+
+const string SelectionPolicy::toString() const
+{
+    return visit([](const auto &policy) { return policy.toString(); }, policy);
+}
+
+int SelectionPolicy::getKind() const
+{
+    return static_cast<int>(policy.index());
+}
+
+const char *SelectionPolicy::getKindName(int kind)
+{
+    static const char *const NAMES[KINDS] = {"nve", "bal", "eco", "env", "weighted"};
+    return NAMES[kind];
+}
+
+bool SelectionPolicy::canSelect(const FacilityCatalog &facilitiesOptions) const
+{
+    return visit([&](const auto &policy) { return policy.canSelect(facilitiesOptions); }, policy);
+}
+
+void SelectionPolicy::appendCycleKey(vector<long long> &key) const
+{
+    visit([&](const auto &policy) { policy.appendCycleKey(key); }, policy);
+}
+
+void SelectionPolicy::appendRunningTotals(vector<long long> &totals) const
+{
+    visit([&](const auto &policy) { policy.appendRunningTotals(totals); }, policy);
+}
+
+void SelectionPolicy::addRunningTotals(const vector<long long> &delta, long long times)
+{
+    visit([&](auto &policy) { policy.addRunningTotals(delta, times); }, policy);
+}
+
+void SelectionPolicy::save(SnapshotWriter &writer) const
+{
+    visit([&](const auto &policy) { policy.save(writer); }, policy);
+}
+
+SelectionPolicy SelectionPolicy::load(SnapshotReader &reader, const FacilityCatalog &facilitiesOptions, const vector<shared_ptr<const WeightedPolicy>> &definitions)
+{
+    const PolicyTag tag = static_cast<PolicyTag>(reader.readU8());
+    if (tag == PolicyTag::WEIGHTED)
+    {
+        const string name = reader.readString();
+        for (const shared_ptr<const WeightedPolicy> &definition : definitions)
+        {
+            if (definition->getName() == name)
+            {
+                return WeightedSelection(definition);
+            }
+        }
+        reader.fail("unknown selection policy");
+    }
+    if (tag == PolicyTag::BALANCED)
+    {
+        const long long lifeQualityScore = reader.readI64();
+        const long long economyScore = reader.readI64();
+        const long long environmentScore = reader.readI64();
+        return BalancedSelection(lifeQualityScore, economyScore, environmentScore);
+    }
+
+    const int lastSelectedIndex = reader.readI32();
+    if (lastSelectedIndex < 0 || (lastSelectedIndex > 0 && lastSelectedIndex >= facilitiesOptions.size()))
+    {
+        reader.fail("bad policy index");
+    }
+    switch (tag)
+    {
+    case PolicyTag::NAIVE:
+        return NaiveSelection(lastSelectedIndex);
+    case PolicyTag::ECONOMY:
+        return EconomySelection(lastSelectedIndex);
+    case PolicyTag::SUSTAINABILITY:
+        return SustainabilitySelection(lastSelectedIndex);
+    default:
+        reader.fail("unknown selection policy");
+    }
 }
@@ -1,5 +1,4 @@
 #include "Settlement.h"
-#include <sstream>
 #include <unordered_map>
 #include <stdexcept>
 using namespace std;
@@ -17,25 +16,31 @@ SettlementType Settlement::getType() const
     return type;
 }
 
-const string Settlement::toString() const
+string Settlement::settlementTypeToString(SettlementType type) const
 {
-    ostringstream oss;
-    oss << "Settlement Name: " << name << 
-
-    switch (this->getType())
+    switch (type)
     {
     case SettlementType::VILLAGE:
-        oss << "Village";
-        break;
+        return "Village";
     case SettlementType::CITY:
-        oss << "City";
-        break;
+        return "City";
     case SettlementType::METROPOLIS:
-        oss << "Metropolis";
-        break;
+        return "Metropolis";
     default:
-        oss << "Unknown Settlement Type";
+        return "Unknown Settlement Type";
     }
+}
+
+const string Settlement::toString() const
+{
+    string text;
+    TextWriter out(text);
+    render(out);
+    out.flush();
+    return text;
+}
 
-    return oss.str();
+void Settlement::render(TextWriter &out) const
+{
+    out << "Settlement Name: " << name << ", Type: " << settlementTypeToString(type);
 }
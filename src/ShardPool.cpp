@@ -0,0 +1,466 @@
+#include "ShardPool.h"
+#include "Auxiliary.h"
+#include "BatchIO.h"
+#include "TextWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <pthread.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+using namespace std;
+
+//Bytes each ring holds; a longer message goes through in pieces
+static const size_t RING_BYTES = 1 << 20;
+//Text a worker collects before passing it on
+static const size_t OUTPUT_BLOCK_BYTES = 1 << 16;
+//How long a side sleeps on a ring before checking the other side is still running
+static const long PEER_CHECK_NANOSECONDS = 100000000;
+
+struct SharedRing
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned long long written; //Bytes written and read so far; their difference is what the ring holds
+    unsigned long long read;
+    char data[RING_BYTES];
+};
+
+//The coordinator is the worker's parent; a worker is only reaped by the coordinator once it ended
+static bool isRunning(pid_t peer)
+{
+    return peer == getppid() || waitpid(peer, nullptr, WNOHANG) == 0;
+}
+
+//Waits on the ring with its lock held, giving up once the other side is gone
+static void waitForPeer(SharedRing *shared, pid_t peer)
+{
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += PEER_CHECK_NANOSECONDS;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    if (pthread_cond_timedwait(&shared->changed, &shared->lock, &deadline) == ETIMEDOUT && !isRunning(peer))
+    {
+        pthread_mutex_unlock(&shared->lock);
+        throw runtime_error("Shard process " + to_string(peer) + " stopped");
+    }
+}
+
+static string formatFailure(const ShardFailure &failure)
+{
+    return to_string(failure.tick) + ' ' + to_string(failure.planId) + ' ' + failure.message;
+}
+
+static ShardFailure parseFailure(const string &text)
+{
+    ShardFailure failure;
+    char *end;
+    failure.tick = strtoll(text.c_str(), &end, 10);
+    failure.planId = static_cast<int>(strtol(end, &end, 10));
+    failure.message = string(*end == ' ' ? end + 1 : end);
+    return failure;
+}
+
+// ShardRing
+ShardRing::ShardRing(SharedRing *shared, pid_t peer) : shared(shared), peer(peer) {}
+
+//A message is its kind, its length and its payload
+void ShardRing::send(ShardMessage kind, string_view payload)
+{
+    char header[5];
+    header[0] = static_cast<char>(kind);
+    const uint32_t length = static_cast<uint32_t>(payload.size());
+    memcpy(header + 1, &length, sizeof(length));
+    write(header, sizeof(header));
+    write(payload.data(), payload.size());
+}
+
+ShardMessage ShardRing::receive(string &payload)
+{
+    char header[5];
+    read(header, sizeof(header));
+    uint32_t length;
+    memcpy(&length, header + 1, sizeof(length));
+    payload.resize(length);
+    read(&payload[0], length);
+    return static_cast<ShardMessage>(header[0]);
+}
+
+void ShardRing::write(const char *data, size_t size)
+{
+    pthread_mutex_lock(&shared->lock);
+    while (size > 0)
+    {
+        const size_t space = RING_BYTES - (shared->written - shared->read);
+        if (space == 0)
+        {
+            waitForPeer(shared, peer);
+            continue;
+        }
+        const size_t position = shared->written % RING_BYTES;
+        const size_t count = min({size, space, RING_BYTES - position});
+        memcpy(shared->data + position, data, count);
+        shared->written += count;
+        data += count;
+        size -= count;
+        pthread_cond_broadcast(&shared->changed);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+void ShardRing::read(char *data, size_t size)
+{
+    pthread_mutex_lock(&shared->lock);
+    while (size > 0)
+    {
+        const size_t available = shared->written - shared->read;
+        if (available == 0)
+        {
+            waitForPeer(shared, peer);
+            continue;
+        }
+        const size_t position = shared->read % RING_BYTES;
+        const size_t count = min({size, available, RING_BYTES - position});
+        memcpy(data, shared->data + position, count);
+        shared->read += count;
+        data += count;
+        size -= count;
+        pthread_cond_broadcast(&shared->changed);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// ShardOutput
+ShardOutput::ShardOutput(ShardRing &replies) : replies(replies), buffer(OUTPUT_BLOCK_BYTES), muted(false)
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+ShardOutput::int_type ShardOutput::overflow(int_type ch)
+{
+    sync();
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+void ShardOutput::setMuted(bool muted)
+{
+    sync();
+    this->muted = muted;
+}
+
+int ShardOutput::sync()
+{
+    if (pptr() > pbase() && !muted)
+    {
+        replies.send(ShardMessage::OUTPUT, string_view(pbase(), pptr() - pbase()));
+    }
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return 0;
+}
+
+// ShardLink
+ShardLink::ShardLink(SharedRing *commands, SharedRing *replies, pid_t coordinator, int shard, int shardCount)
+    : commands(commands, coordinator), replies(replies, coordinator), output(this->replies), shard(shard), shardCount(shardCount) {}
+
+streambuf *ShardLink::getOutput()
+{
+    return &output;
+}
+
+bool ShardLink::nextCommand(string &line)
+{
+    const ShardMessage kind = commands.receive(line);
+    output.setMuted(kind == ShardMessage::QUIET_COMMAND);
+    return kind == ShardMessage::COMMAND || kind == ShardMessage::QUIET_COMMAND;
+}
+
+void ShardLink::endCommand(bool closed)
+{
+    output.pubsync();
+    replies.send(ShardMessage::DONE, closed ? "closed" : "");
+}
+
+void ShardLink::endSection()
+{
+    output.pubsync();
+    replies.send(ShardMessage::SECTION, "");
+}
+
+ShardFailure ShardLink::agreeOnFailure(const ShardFailure &failure)
+{
+    output.pubsync();
+    replies.send(ShardMessage::STEP, formatFailure(failure));
+    return parseFailure(expect(ShardMessage::DECISION));
+}
+
+string ShardLink::expect(ShardMessage kind)
+{
+    string payload;
+    if (commands.receive(payload) != kind)
+    {
+        throw runtime_error("Unexpected message from the coordinator");
+    }
+    return payload;
+}
+
+// ShardPool
+//The segment is unlinked as soon as it is mapped: the workers inherit the mapping, and nothing is
+//left behind however the processes end
+ShardPool::ShardPool(int shardCount) : shardCount(shardCount), self(-1), coordinator(0), rings(nullptr), mappedBytes(2 * shardCount * sizeof(SharedRing)), workers(), commands(), replies(), running(false)
+{
+    if (shardCount < 1)
+    {
+        throw runtime_error("Invalid shard count: " + to_string(shardCount));
+    }
+    const string name = "/simulation-shards-" + to_string(getpid());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        throw runtime_error("Could not create shared memory: " + name);
+    }
+    void *mapping = MAP_FAILED;
+    if (ftruncate(fd, static_cast<off_t>(mappedBytes)) == 0)
+    {
+        mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    shm_unlink(name.c_str());
+    if (mapping == MAP_FAILED)
+    {
+        throw runtime_error("Could not map shared memory: " + name);
+    }
+    rings = static_cast<SharedRing *>(mapping);
+
+    pthread_mutexattr_t lockAttributes;
+    pthread_mutexattr_init(&lockAttributes);
+    pthread_mutexattr_setpshared(&lockAttributes, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_t conditionAttributes;
+    pthread_condattr_init(&conditionAttributes);
+    pthread_condattr_setpshared(&conditionAttributes, PTHREAD_PROCESS_SHARED);
+    for (int ring = 0; ring < 2 * shardCount; ++ring)
+    {
+        pthread_mutex_init(&rings[ring].lock, &lockAttributes);
+        pthread_cond_init(&rings[ring].changed, &conditionAttributes);
+        rings[ring].written = 0;
+        rings[ring].read = 0;
+    }
+    pthread_condattr_destroy(&conditionAttributes);
+    pthread_mutexattr_destroy(&lockAttributes);
+}
+
+//Workers still reading commands are told to quit; one that has gone already makes send throw
+ShardPool::~ShardPool()
+{
+    if (self < 0)
+    {
+        for (ShardRing &ring : commands)
+        {
+            try
+            {
+                ring.send(ShardMessage::QUIT, "");
+            }
+            catch (const runtime_error &)
+            {
+            }
+        }
+        for (pid_t worker : workers)
+        {
+            waitpid(worker, nullptr, 0);
+        }
+    }
+    munmap(rings, mappedBytes);
+}
+
+SharedRing *ShardPool::commandRing(int shard) const
+{
+    return &rings[2 * shard];
+}
+
+SharedRing *ShardPool::replyRing(int shard) const
+{
+    return &rings[2 * shard + 1];
+}
+
+//Nothing may be left in cout's buffer, or every worker would print it again
+int ShardPool::spawn()
+{
+    cout.flush();
+    coordinator = getpid();
+    for (int shard = 0; shard < shardCount; ++shard)
+    {
+        const pid_t worker = fork();
+        if (worker < 0)
+        {
+            throw runtime_error("Could not start shard " + to_string(shard));
+        }
+        if (worker == 0)
+        {
+            self = shard;
+            return shard;
+        }
+        workers.push_back(worker);
+        commands.emplace_back(commandRing(shard), worker);
+        replies.emplace_back(replyRing(shard), worker);
+    }
+    return -1;
+}
+
+shared_ptr<ShardLink> ShardPool::getLink(int shard)
+{
+    return make_shared<ShardLink>(commandRing(shard), replyRing(shard), coordinator, shard, shardCount);
+}
+
+void ShardPool::start()
+{
+    running = true;
+    cout << "The simulation has started" << endl;
+    string input;
+    while (running && getline(cin, input))
+    {
+        runCommand(input);
+        cout.flush();
+    }
+}
+
+void ShardPool::startBatch(const string &scriptPath)
+{
+    const int inputFd = scriptPath.empty() ? STDIN_FILENO : ::open(scriptPath.c_str(), O_RDONLY);
+    if (inputFd < 0)
+    {
+        throw runtime_error("Could not open script file: " + scriptPath);
+    }
+    CommandReader input(inputFd);
+    BatchOutput output(STDOUT_FILENO);
+    cout.flush();
+    struct OutputRedirect
+    {
+        streambuf *console;
+        ~OutputRedirect()
+        {
+            cout.flush();
+            cout.rdbuf(console);
+        }
+    } redirect{cout.rdbuf(&output)};
+
+    running = true;
+    cout << "The simulation has started\n";
+    string_view line;
+    while (running && input.nextLine(line))
+    {
+        runCommand(line);
+    }
+    if (inputFd != STDIN_FILENO)
+    {
+        ::close(inputFd);
+    }
+}
+
+//Every worker runs every command that changes the simulation, so they would all print the same
+//for those; commands about one plan are printed by its owner. stats and trace only go to worker 0,
+//as they change nothing the others would need, and flush is the coordinator's own
+void ShardPool::runCommand(string_view line)
+{
+    string_view arguments[2];
+    const int count = Auxiliary::splitArguments(line, arguments, 2);
+    if (count > 0 && arguments[0] == "flush")
+    {
+        cout.flush();
+        return;
+    }
+    int shown = 0;
+    int planId;
+    if (count >= 2 && (arguments[0] == "planStatus" || arguments[0] == "changePolicy") && Auxiliary::parseInteger(arguments[1], planId) && planId >= 0)
+    {
+        shown = planId % shardCount;
+    }
+    const bool closing = count > 0 && arguments[0] == "close";
+    const int recipients = count > 0 && (arguments[0] == "stats" || arguments[0] == "trace") ? 1 : shardCount;
+    for (int shard = 0; shard < recipients; ++shard)
+    {
+        commands[shard].send(closing || shard == shown ? ShardMessage::COMMAND : ShardMessage::QUIET_COMMAND, line);
+    }
+
+    TextWriter out(cout.rdbuf());
+    string payload;
+    if (closing)
+    {
+        //Plan i is the (i / shardCount)th section of worker i % shardCount, so the first worker out of
+        //sections comes right after the last plan; what the workers print after their plans follows
+        int shard = 0;
+        while (readReply(shard, out, payload) == ShardMessage::SECTION)
+        {
+            shard = (shard + 1) % shardCount;
+        }
+        for (int rest = 1; rest < shardCount; ++rest)
+        {
+            if (readReply((shard + rest) % shardCount, out, payload) != ShardMessage::DONE)
+            {
+                throw runtime_error("Unexpected message from shard " + to_string((shard + rest) % shardCount));
+            }
+        }
+        return;
+    }
+
+    //A step stops every worker until they agree on how it ended, see Simulation::stepShard
+    while (true)
+    {
+        ShardFailure first{-1, 0, ""};
+        bool stepped = false;
+        for (int shard = 0; shard < recipients; ++shard)
+        {
+            if (readReply(shard, out, payload) == ShardMessage::STEP)
+            {
+                stepped = true;
+                const ShardFailure failure = parseFailure(payload);
+                if (failure.tick >= 0 && (first.tick < 0 || make_pair(failure.tick, failure.planId) < make_pair(first.tick, first.planId)))
+                {
+                    first = failure;
+                }
+            }
+        }
+        if (!stepped)
+        {
+            return;
+        }
+        for (int shard = 0; shard < recipients; ++shard)
+        {
+            commands[shard].send(ShardMessage::DECISION, formatFailure(first));
+        }
+    }
+}
+
+ShardMessage ShardPool::readReply(int shard, TextWriter &out, string &payload)
+{
+    while (true)
+    {
+        const ShardMessage kind = replies[shard].receive(payload);
+        if (kind == ShardMessage::OUTPUT)
+        {
+            out << payload;
+            continue;
+        }
+        if (kind == ShardMessage::DONE)
+        {
+            running = running && payload != "closed";
+        }
+        else if (kind != ShardMessage::SECTION && kind != ShardMessage::STEP)
+        {
+            throw runtime_error("Unexpected message from shard " + to_string(shard));
+        }
+        return kind;
+    }
+}
@@ -4,352 +4,1004 @@
 #include "SelectionPolicy.h"
 #include "Settlement.h"
 #include "Facility.h"
+#include "FacilityCatalog.h"
 #include "Plan.h"
 #include "Action.h"
-#include <fstream>
-#include <sstream>
+#include "Snapshot.h"
+#include "ConfigFile.h"
+#include "BatchIO.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fcntl.h>
+#include <mutex>
 #include <stdexcept>
+#include <unistd.h>
+#include <unordered_map>
 using namespace std;
 
+//Plans per selection task handed to the thread pool
+const int SELECTION_GRAIN = 64;
+//Steps shorter than this run tick by tick; cycles only pay off when many of them fit
+const long long CYCLE_DETECTION_MIN_STEPS = 1024;
+
 class BaseAction;
-class SelectionPolicy;
 
 
 //Constructor
-Simulation::Simulation(const std::string &configFilePath) 
-    : isRunning(false), planCounter(0) {
-    std::ifstream configFile(configFilePath);
-    if (!configFile.is_open()) {
-        throw runtime_error("Could not open configuration file: " + configFilePath);
+//Lines are tokenized in parallel when threadCount > 1, then applied in file order
+Simulation::Simulation(const std::string &configFilePath, int threadCount)
+    : isRunning(false), planCounter(0), currentTick(0), actionsLog(), plans(), settlements(), facilitiesOptions(), policyDefinitions(), settlementIndex(), facilityIndex(), constructions(), scheduler(), readyPlans(), cycleDetectors(), cycleKey(), failedTick(-1), failedPlan(0), threadPool(), stats(make_shared<SimulationStats>()), trace(make_shared<TraceRecorder>()), shard(), undoTarget() {
+    setThreadCount(threadCount);
+    ConfigFile configFile(configFilePath);
+    for (const ConfigEntry &entry : configFile.parse(threadPool.get())) {
+        if (entry.kind == ConfigEntry::SETTLEMENT) {
+            if (findSettlement(entry.name) < 0) {
+                addSettlement(new Settlement(string(entry.name), static_cast<SettlementType>(entry.values[0])));
+            }
+        } else if (entry.kind == ConfigEntry::FACILITY) {
+            addFacility(FacilityType(string(entry.name), static_cast<FacilityCategory>(entry.values[0]), entry.values[1], entry.values[2], entry.values[3], entry.values[4]));
+        } else if (entry.kind == ConfigEntry::POLICY) {
+            try {
+                definePolicy(string(entry.name), string(entry.policy));
+            } catch (const runtime_error &e) {
+                configFile.fail(entry.line, e.what());
+            }
+        } else {
+            const int settlementId = findSettlement(entry.name);
+            if (settlementId < 0) {
+                configFile.fail(entry.line, "settlement does not exist: " + string(entry.name));
+            }
+            SelectionPolicy policy;
+            if (!createSelectionPolicy(string(entry.policy), policy)) {
+                configFile.fail(entry.line, "invalid selection policy: " + string(entry.policy));
+            }
+            addPlan(*settlements[settlementId], policy);
+        }
     }
+}
 
-    string line;
-    while (getline(configFile, line)) {
-        vector<string> arguments = Auxiliary::parseArguments(line);
-        if(arguments.empty()){
-            continue;
-        }   
-        if (arguments[0] == "settlement") {
-            addSettlement(new Settlement(arguments[1], stoi(arguments[2])));
-        } else if (arguments[0] == "facility") {
-            addFacility(FacilityType(arguments[1], static_cast<FacilityCategory>(stoi(arguments[2])), stoi(arguments[3]), stoi(arguments[4]), stoi(arguments[5]), stoi(arguments[6])));
-        } else if (arguments[0] == "plan") {
-            Settlement &settlement = getSettlement(arguments[1]);
-            SelectionPolicy *policy = createSelectionPolicy(arguments[2]);
-            addPlan(settlement, policy);
-            delete policy;
-            policy = nullptr;
+
+bool Simulation::createSelectionPolicy(const string &policyName, SelectionPolicy &policy, long long lifeQualityScore, long long economyScore, long long environmentScore) const {
+    if (SelectionPolicy::create(policyName, lifeQualityScore, economyScore, environmentScore, policy)) {
+        return true;
+    }
+    for (const shared_ptr<const WeightedPolicy> &definition : *policyDefinitions) {
+        if (definition->getName() == policyName) {
+            policy = WeightedSelection(definition);
+            return true;
         }
+    }
+    return false;
+}
 
-    configFile.close();
+void Simulation::definePolicy(const string &policyName, const string &definition) {
+    SelectionPolicy existing;
+    if (createSelectionPolicy(policyName, existing)) {
+        throw runtime_error("Policy already exists: " + policyName);
+    }
+    policyDefinitions.write().push_back(make_shared<const WeightedPolicy>(policyName, definition));
 }
 
 
-SelectionPolicy* Simulation::createSelectionPolicy(const string &policyName) {
-    if (policyName == "nve") return new NaiveSelection();
-    if (policyName == "bal") return new BalancedSelection(0,0,0);
-    if (policyName == "eco") return new EconomySelection();
-    if (policyName == "env") return new SustainabilitySelection();
-    return nullptr;
-}
+// Commands by name. Each gives the fewest arguments it takes after its name and builds its
+// action from the split line, returning nullptr when a number in it does not parse. A command
+// taking free text gets the rest of the line, spaces and all, as its last argument.
+struct Command {
+    int minArguments;
+    BaseAction *(*build)(const string_view *arguments, int count);
+    bool endsWithText;
+};
+
+//facility and its six arguments is the longest command
+const int MAX_COMMAND_ARGUMENTS = 7;
+
+const unordered_map<string_view, Command> COMMANDS = {
+    {"step", {1, [](const string_view *arguments, int) -> BaseAction * {
+        int numOfSteps;
+        return Auxiliary::parseInteger(arguments[1], numOfSteps) ? new SimulateStep(numOfSteps) : nullptr;
+    }, false}},
+    {"plan", {2, [](const string_view *arguments, int) -> BaseAction * {
+        return new AddPlan(string(arguments[1]), string(arguments[2]));
+    }, false}},
+    {"settlement", {2, [](const string_view *arguments, int) -> BaseAction * {
+        int settlementType;
+        if (!Auxiliary::parseInteger(arguments[2], settlementType) || !Auxiliary::isTypeCode(settlementType)) {
+            return nullptr;
+        }
+        return new AddSettlement(string(arguments[1]), static_cast<SettlementType>(settlementType));
+    }, false}},
+    {"facility", {6, [](const string_view *arguments, int) -> BaseAction * {
+        int values[5];
+        for (int i = 0; i < 5; ++i) {
+            if (!Auxiliary::parseInteger(arguments[i + 2], values[i])) {
+                return nullptr;
+            }
+        }
+        if (!Auxiliary::isTypeCode(values[0])) {
+            return nullptr;
+        }
+        return new AddFacility(string(arguments[1]), static_cast<FacilityCategory>(values[0]), values[1], values[2], values[3], values[4]);
+    }, false}},
+    {"planStatus", {1, [](const string_view *arguments, int) -> BaseAction * {
+        int planId;
+        return Auxiliary::parseInteger(arguments[1], planId) ? new PrintPlanStatus(planId) : nullptr;
+    }, false}},
+    {"changePolicy", {2, [](const string_view *arguments, int) -> BaseAction * {
+        int planId;
+        return Auxiliary::parseInteger(arguments[1], planId) ? new ChangePlanPolicy(planId, string(arguments[2])) : nullptr;
+    }, false}},
+    {"policy", {2, [](const string_view *arguments, int) -> BaseAction * {
+        return new DefinePolicy(string(arguments[1]), string(arguments[2]));
+    }, true}},
+    {"log", {0, [](const string_view *, int) -> BaseAction * {
+        return new PrintActionsLog();
+    }, false}},
+    {"backup", {0, [](const string_view *arguments, int count) -> BaseAction * {
+        return new BackupSimulation(count > 1 ? string(arguments[1]) : "");
+    }, false}},
+    {"restore", {0, [](const string_view *arguments, int count) -> BaseAction * {
+        return new RestoreSimulation(count > 1 ? string(arguments[1]) : "");
+    }, false}},
+    {"save", {1, [](const string_view *arguments, int) -> BaseAction * {
+        return new SaveSimulation(string(arguments[1]));
+    }, false}},
+    {"load", {1, [](const string_view *arguments, int) -> BaseAction * {
+        return new LoadSimulation(string(arguments[1]));
+    }, false}},
+    {"undo", {0, [](const string_view *arguments, int count) -> BaseAction * {
+        int numOfActions = 1;
+        return count < 2 || Auxiliary::parseInteger(arguments[1], numOfActions) ? new UndoActions(numOfActions) : nullptr;
+    }, false}},
+    {"close", {0, [](const string_view *, int) -> BaseAction * {
+        return new Close();
+    }, false}},
+};
 
+//start the simulation
+void Simulation::start() {
+    open();
+    cout<< "The simulation has started" << endl;
+    string input;
+    while (isRunning && getline(cin, input)) {
+        runCommand(input);
+        cout.flush();
+    }
+}
 
-//copy constructor  
-Simulation::Simulation(const Simulation &other) 
-    : isRunning(other.isRunning),
-    planCounter(other.planCounter),
-    actionsLog(),
-    settlements(), 
-    plans() {
-    for (const BaseAction* action : other.actionsLog) {
-        actionsLog.push_back(action->clone());
+//Runs the commands in scriptPath, or stdin if it is empty, without flushing between them
+void Simulation::startBatch(const string &scriptPath) {
+    const int inputFd = scriptPath.empty() ? STDIN_FILENO : ::open(scriptPath.c_str(), O_RDONLY);
+    if (inputFd < 0) {
+        throw runtime_error("Could not open script file: " + scriptPath);
     }
+    CommandReader input(inputFd);
+    BatchOutput output(STDOUT_FILENO);
+    cout.flush();
+    //Writes out the rest and gives cout its own buffer back, however the batch ends
+    struct OutputRedirect {
+        streambuf *console;
+        ~OutputRedirect() {
+            cout.flush();
+            cout.rdbuf(console);
+        }
+    } redirect{cout.rdbuf(&output)};
 
-    facilitiesOptions.clear();
-    for (const FacilityType& facility : other.facilitiesOptions){
-        facilitiesOptions.push_back(facility);
+    open();
+    cout << "The simulation has started\n";
+    string_view line;
+    while (isRunning && input.nextLine(line)) {
+        runCommand(line);
+    }
+    if (inputFd != STDIN_FILENO) {
+        ::close(inputFd);
     }
+}
 
-    for (const Settlement* settlement : other.settlements) {
-        settlements.push_back(new Settlement(*settlement));
+//Runs the commands one at a time, telling the coordinator when each is done
+void Simulation::startShard(const shared_ptr<ShardLink> &link) {
+    shard = link;
+    cout.flush();
+    struct OutputRedirect {
+        streambuf *console;
+        ~OutputRedirect() {
+            cout.flush();
+            cout.rdbuf(console);
+        }
+    } redirect{cout.rdbuf(shard->getOutput())};
+
+    open();
+    string line;
+    while (isRunning && shard->nextCommand(line)) {
+        runCommand(line);
+        shard->endCommand(!isRunning);
     }
+}
 
-    for (const Plan &plan : other.plans) {
-        plans.push_back(Plan(plan));
+//Runs one line of input. flush writes out batch output early and is not logged
+void Simulation::runCommand(string_view line) {
+    string_view arguments[MAX_COMMAND_ARGUMENTS];
+    const int count = Auxiliary::splitArguments(line, arguments, MAX_COMMAND_ARGUMENTS);
+    if (count == 0) {
+        return;
+    }
+    if (arguments[0] == "flush") {
+        cout.flush();
+        return;
+    }
+    if (arguments[0] == "stats") {
+        runStatsCommand(count > 1 ? arguments[1] : string_view());
+        return;
+    }
+    if (arguments[0] == "trace") {
+        runTraceCommand(arguments, count);
+        return;
     }
-    for (const auto &plan : other.plans) {
-        Plan newPlan = Plan(plan.getPlanID(), plan.getSettlement(), plan.getSelectionPolicy(), plan.getFacilities());
-        newPlan.setLifeQualityScore(plan.getLifeQualityScore());    
-        newPlan.setEconomyScore(plan.getEconomyScore());
-        newPlan.setEnvironmentScore(plan.getEnvironmentScore());
-        newPlan.setPlanStatus(plan.getPlanStatus());
-        newPlan.setConstructionLimit(plan.getConstructionLimit());
-        for (const auto &facility : plan.getFacilities()) {
-            newPlan.addFacility(facility->clone());
+    const bool timed = stats->isEnabled();
+    const chrono::steady_clock::time_point started = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+
+    BaseAction *action = nullptr;
+    const auto command = COMMANDS.find(arguments[0]);
+    if (command != COMMANDS.end() && count > command->second.minArguments) {
+        int argumentCount = count;
+        if (command->second.endsWithText) {
+            argumentCount = command->second.minArguments + 1;
+            arguments[argumentCount - 1] = Auxiliary::restOfLine(line, arguments[argumentCount - 1]);
         }
-        for (const auto &facility : plan.getUnderConstruction()) {
-            newPlan.addUnderConstruction(facility->clone());
+        action = command->second.build(arguments, argumentCount);
+    }
+    if (action == nullptr) {
+        cout << "Invalid command\n";
+        return;
+    }
+    {
+        //Command names are views of string literals, as trace spans need
+        TraceSpan span(*trace, command->first);
+        action->act(*this);
+    }
+    addAction(action);
+    if (timed) {
+        stats->recordCommand(arguments[0], chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count());
+    }
+    if (!isRunning && !trace->empty()) {
+        try {
+            trace->dump(trace->getPath());
+        } catch (const runtime_error &e) {
+            cout << "Error: " << e.what() << "\n";
         }
     }
 }
 
-//destructor
-Simulation::~Simulation() {
-    for (BaseAction* action : actionsLog) {
-        delete action;
+//trace on [file] records spans from now on, to be written to file (trace.json unless given) on
+//close; trace off stops recording and trace dump [file] writes out what was recorded so far
+void Simulation::runTraceCommand(const string_view *arguments, int count) {
+    const string_view option = count > 1 ? arguments[1] : string_view();
+    if (option == "on" && count <= 3) {
+        startTracing(count > 2 ? string(arguments[2]) : trace->getPath());
+    } else if (option == "off" && count == 2) {
+        trace->setEnabled(false);
+    } else if (option == "dump" && count <= 3) {
+        try {
+            trace->dump(count > 2 ? string(arguments[2]) : trace->getPath());
+        } catch (const runtime_error &e) {
+            cout << "Error: " << e.what() << "\n";
+        }
+    } else {
+        cout << "Invalid command\n";
     }
-    actionsLog.clear();
+}
 
-    for (Settlement* settlement : settlements) {
-        delete settlement;
+//stats prints the counters as text, stats json as one line of JSON; stats on, off and reset
+//control collecting
+void Simulation::runStatsCommand(string_view option) {
+    if (option == "on" || option == "off") {
+        setStatsEnabled(option == "on");
+        return;
+    }
+    if (option == "reset") {
+        stats->reset();
+        return;
+    }
+    if (!option.empty() && option != "text" && option != "json") {
+        cout << "Invalid command\n";
+        return;
+    }
+    //A shard counts the plans it owns
+    int busyPlans = 0;
+    int availablePlans = 0;
+    for (int planId = 0; planId < plans.size(); ++planId) {
+        if (ownsPlan(planId)) {
+            busyPlans += plans[planId]->getPlanStatus() == PlanStatus::BUSY;
+            availablePlans += plans[planId]->getPlanStatus() == PlanStatus::AVALIABLE;
+        }
+    }
+    TextWriter out(cout.rdbuf());
+    if (option == "json") {
+        stats->writeJson(out, busyPlans, availablePlans, actionsLog.size());
+    } else {
+        stats->writeText(out, busyPlans, availablePlans, actionsLog.size());
     }
-    settlements.clear();
-    
 }
 
-//copy assignment operator
-Simulation &Simulation::operator=(const Simulation &other) {
-    if (this != &other) {
-        for (BaseAction* action : actionsLog) {
-            delete action;
-        }
-        actionsLog.clear();
+//add a plan to the simulation
+void Simulation::addPlan(const Settlement &settlement, const SelectionPolicy &selectionPolicy){
+    plans.push_back(make_shared<Plan>(planCounter, settlement, getSettlementId(settlement), selectionPolicy));
+    scheduler.markReady(planCounter);
+    planCounter++;
+}
 
-        for (Settlements* settlement : settlements) {
-            delete settlement;
-        }
-        settlements.clear();
+// Add an action to the ActionLog; only its record is kept
+void Simulation::addAction(BaseAction *action){
+    action->appendTo(actionsLog);
+    delete action;
+}
 
-        facilitiesOptions.clear();
-        for (const FacilityType& facility : other.facilitiesOptions){
-                facilitiesOptions.push_back(move(facility));
-        }
 
-        plans.clear();
+bool Simulation::addSettlement(Settlement *settlement){
+    if(isSettlementExists(settlement->getName())){
+        return false;
+    }
+    else{
+        settlementIndex.add(settlement->getName(), settlements.size());
+        settlements.push_back(shared_ptr<Settlement>(settlement));
+        return true;
+    }
+}
 
+bool Simulation::addFacility(FacilityType facility){
+    if (findFacility(facility.getName()) >= 0) {
+        return false;
+    }
+    facilityIndex.add(facility.getName(), facilitiesOptions->size());
+    facilitiesOptions.write().add(move(facility));
+    return true;
+}
 
-        isRunning = other.isRunning;
-        planCounter = other.planCounter;
+bool Simulation::isSettlementExists(const string &settlementName){
+    return findSettlement(settlementName) >= 0;
+}
 
-        for (const BaseAction* action : other.actionsLog) {
-            actionsLog.push_back(action->clone());
-        }
+Settlement &Simulation::getSettlement(const string &settlementName){
+    const int settlementId = findSettlement(settlementName);
+    if (settlementId < 0) {
+        throw runtime_error("Settlement does not exist: " + settlementName);
+    }
+    return *settlements[settlementId];
+}
 
-        for (const auto &plan : other.plans) {
-            Plan newPlan = Plan(plan.getPlanID(), plan.getSettlement(), plan.getSelectionPolicy(), plan.getFacilities());
-            newPlan.setLifeQualityScore(plan.getLifeQualityScore());
-            newPlan.setEconomyScore(plan.getEconomyScore());
-            newPlan.setEnvironmentScore(plan.getEnvironmentScore());
-            newPlan.setPlanStatus(plan.getPlanStatus());
-            newPlan.setConstructionLimit(plan.getConstructionLimit());
-            for (const auto &facility : plan.getFacilities()) {
-                newPlan.addFacility(facility->clone());
-            }
-            for (const auto &facility : plan.getUnderConstruction()) {
-                newPlan.addUnderConstruction(facility->clone());
-            }
-        }
+//Settlement ids are positions in the settlements list; facility records refer to their settlement by id
+int Simulation::getSettlementId(const Settlement &settlement) const {
+    const int settlementId = findSettlement(settlement.getName());
+    if (settlementId < 0 || settlements[settlementId].get() != &settlement) {
+        throw runtime_error("Settlement is not part of this simulation: " + settlement.getName());
+    }
+    return settlementId;
+}
 
-        for (const Settlement * settlement : other.settlements) {
-            settlements.push_back(new Settlement(*settlement));
-        }
+int Simulation::findSettlement(string_view settlementName) const {
+    return settlementIndex.find(settlementName, [this](int id) -> const string & {
+        return settlements[id]->getName();
+    });
+}
 
+int Simulation::findFacility(string_view facilityName) const {
+    const FacilityCatalog &options = *facilitiesOptions;
+    return facilityIndex.find(facilityName, [&options](int position) -> const string & {
+        return options[position].getName();
+    });
+}
 
-    return *this;
+//Plan ids are positions in the plans list
+Plan &Simulation::getPlan(const int planID){
+    if (planID < 0 || planID >= plans.size()) {
+        throw runtime_error("Plan does not exist: " + to_string(planID));
+    }
+    return writePlan(planID);
 }
 
+const Plan &Simulation::getPlan(const int planID) const {
+    if (planID < 0 || planID >= plans.size()) {
+        throw runtime_error("Plan does not exist: " + to_string(planID));
+    }
+    return *plans[planID];
+}
 
-//move constructor
-Simulation::Simulation(Simulation &&other) noexcept
-    : isRunning(other.isRunning), 
-    planCounter(other.planCounter),
-    actionLog(move(other.actionLog)),
-    settlements(move(other.settlements)),
-    facilitiesOptions(move(other.facilitiesOptions)){
-        for (const Plan &plan : other.plans) {
-            plans.push_back(Plan(plan));
-        }
+//Plans shared with a backup are copied before their first change
+Plan &Simulation::writePlan(int planId){
+    shared_ptr<Plan> &plan = plans.write(planId);
+    if (undoTarget.record) {
+        undoTarget.record->keepPlan(planId, *plan);
+    }
+    if (plan.use_count() > 1) {
+        plan = make_shared<Plan>(*plan);
+    }
+    return *plan;
+}
+
+const vector<FacilityType> &Simulation::getFacilityOptions() const {
+    return facilitiesOptions->getTypes();
+}
 
-        other.isRunning = false;
-        other.planCounter = 0;
-        other.actionLog.clear();
-        other.settlements.clear();
+int Simulation::getPlanCounter() const {
+    return planCounter;
+}
+
+const ActionLog &Simulation::getActionsLog() const {
+    return actionsLog;
+}
+
+void Simulation::setLogLimit(int limit, const string &spillPath) {
+    actionsLog.setLimit(limit, spillPath);
+}
+
+void Simulation::setStatsEnabled(bool enabled) {
+    stats->setEnabled(enabled);
+}
+
+void Simulation::startTracing(const string &path) {
+    trace->setPath(path);
+    trace->setEnabled(true);
+}
+
+void Simulation::setThreadCount(int threadCount) {
+    if (threadCount <= 1) {
+        threadPool.reset();
+    } else {
+        threadPool = make_shared<ThreadPool>(threadCount);
     }
 }
 
+void Simulation::step(){
+    step(1);
+}
 
-//move assignment operator
-Simulation &Simulation::operator=(Simulation &&other) {
-    if (this != &other) {
-        for (BaseAction* action : actionsLog) {
-            delete action;
+//Advances numOfSteps ticks, only visiting the ticks on which some plan fills its slots or some
+//construction finishes. Every other tick would change nothing but the time left on constructions,
+//which the table derives from the current tick. No steps, or fewer, change nothing at all
+void Simulation::step(int numOfSteps){
+    if (numOfSteps <= 0) {
+        return;
+    }
+    TraceSpan span(*trace, "Simulation::step", nullptr, numOfSteps);
+    const long long lastTick = currentTick + numOfSteps;
+    if (shard) {
+        stepShard(lastTick);
+    } else {
+        startCycleDetection(numOfSteps);
+        try {
+            runTicks(lastTick, -1);
+        } catch (...) {
+            cycleDetectors.clear();
+            throw;
         }
-        actionsLog.clear();
+        cycleDetectors.clear();
+        currentTick = lastTick;
+    }
+    if (stats->isEnabled()) {
+        stats->recordStep(numOfSteps);
+    }
+}
 
-        for (Settlement* settlement : settlements) {
-            delete settlement;
+//Runs the ticks up to lastTick that have any work, leaving currentTick on the last of them. A tick
+//that throws is kept in failedTick, and currentTick is left just before it: the plans that picked
+//on it have started building, but no construction has moved on. With stopPlan >= 0, lastTick stops
+//at that plan as it would if the plan's selection failed there
+void Simulation::runTicks(long long lastTick, int stopPlan){
+    failedPlan = planCounter;
+    while (true) {
+        long long nextTick = lastTick + 1;
+        if (scheduler.hasReady() && !facilitiesOptions->empty()) {
+            nextTick = currentTick + 1;
+        } else {
+            if (scheduler.hasCompletions()) {
+                nextTick = min(nextTick, scheduler.getNextCompletionTick());
+            }
+            if (scheduler.hasWakeups()) {
+                nextTick = min(nextTick, scheduler.getNextWakeupTick());
+            }
+        }
+        if (nextTick > lastTick) {
+            break;
+        }
+        const int stopAt = nextTick == lastTick ? stopPlan : -1;
+        try {
+            runTick(nextTick, lastTick, stopAt);
+        } catch (...) {
+            failedTick = nextTick;
+            currentTick = nextTick - 1;
+            throw;
         }
-        settlements.clear();
+        currentTick = nextTick;
+        if (stopAt >= 0) {
+            break; //its completions are still queued
+        }
+    }
+}
 
-        isRunning = other.isRunning;
-        planCounter = other.planCounter;
-        settlements = other.settlements;
-        actionsLog = other.actionsLog;
-        facilitiesOptions = move(other.facilitiesOptions);
-        plans = move(other.plans);
+//A shard steps its own plans alone, then all shards agree on how the step ended. A single process
+//stops at the lowest plan failing on the first tick a selection fails on, so every shard but the one
+//that failed there starts over from a copy taken before the step and stops at that plan as well
+void Simulation::stepShard(long long lastTick){
+    const Simulation before = *this;
+    ShardFailure failure{-1, 0, ""};
+    startCycleDetection(lastTick - currentTick);
+    try {
+        runTicks(lastTick, -1);
+        currentTick = lastTick;
+    } catch (const runtime_error &e) {
+        failure = ShardFailure{failedTick, failedPlan, e.what()};
     }
+    cycleDetectors.clear();
 
-    return *this;
+    const ShardFailure first = shard->agreeOnFailure(failure);
+    if (first.tick < 0) {
+        return;
+    }
+    if (failure.tick != first.tick || failure.planId != first.planId) {
+        *this = before;
+        runTicks(first.tick, first.planId);
+    }
+    currentTick = first.tick - 1;
+    throw runtime_error(first.message);
 }
 
+bool Simulation::ownsPlan(int planId) const {
+    return !shard || shard->ownsPlan(planId);
+}
 
-//start the simulation
-void Simulation::start() {
-    open();
-    cout<< "The simulation has started\n"; 
-    while (isRunning)
-    {
-        string input;   
-        getline(cin, input);
-        vector<string> arguments = Auxiliary::parseArguments(input);
-        if(arguments.empty()){
-            continue;
-        }
-        else if (arguments[0] == "step") {
-            addAction(new SimulateStep(stoi(arguments[1]))->act(*this));
+//Skipping cycles moves plans ahead of the others, which is only safe when no plan can make the step
+//stop early: a policy that has nothing to pick from throws on its next fill
+void Simulation::startCycleDetection(long long numOfSteps){
+    if (numOfSteps < CYCLE_DETECTION_MIN_STEPS || facilitiesOptions->empty()) {
+        return;
+    }
+    for (int planId = 0; planId < plans.size(); ++planId) {
+        if (ownsPlan(planId) && !plans[planId]->getSelectionPolicy().canSelect(*facilitiesOptions)) {
+            return;
         }
+    }
+    cycleDetectors.assign(plans.size(), CycleDetector());
+}
 
-        else if (arguments[0] == "plan"){
-            addAction(new AddPlan(arguments[1], arguments[2])->act(*this));
+//Takes out of readyPlans every plan whose state on this tick matches an earlier fill of this step.
+//Such a plan repeats the same period from here on, so as many whole periods as fit before lastTick
+//are applied at once and the plan sleeps until the tick they end on, where it fills as it would now
+void Simulation::skipCycles(long long tick, long long lastTick){
+    ConstructionTable &constructions = this->constructions.write();
+    size_t kept = 0;
+    for (int planId : readyPlans) {
+        CycleDetector &detector = cycleDetectors[planId];
+        Plan &plan = writePlan(planId);
+        if (detector.isActive() && plan.getCycleKey(constructions, tick, cycleKey)) {
+            const CycleDetector::Mark *found = detector.findOrRecord(cycleKey, plan.getCycleMark(tick));
+            if (found != nullptr) {
+                const CycleDetector::Mark start = *found;
+                detector.stop();
+                const long long period = tick - start.tick;
+                const long long periods = (lastTick - tick) / period;
+                const long long builtBefore = plan.getFacilityCount();
+                const int buildingBefore = plan.getUnderConstruction().size();
+                if (undoTarget.record && periods > 0) {
+                    for (int row : plan.getUnderConstruction()) {
+                        undoTarget.record->keepRow(constructions, row);
+                    }
+                }
+                if (periods > 0 && plan.skipCycles(start, tick, periods, constructions)) {
+                    if (stats->isEnabled()) {
+                        const long long completed = plan.getFacilityCount() - builtBefore;
+                        stats->recordFacilities(completed + plan.getUnderConstruction().size() - buildingBefore, completed);
+                    }
+                    //The old completion events find nothing left to collect and are dropped
+                    for (int row : plan.getUnderConstruction()) {
+                        scheduler.scheduleCompletion(constructions.getFinishTick(row), planId);
+                    }
+                    scheduler.scheduleWakeup(tick + period * periods, planId);
+                    continue;
+                }
+            }
         }
+        readyPlans[kept++] = planId;
+    }
+    readyPlans.resize(kept);
+}
+
+//One tick: ready plans pick facilities for their free slots, the picks enter the construction table
+//in plan order, then every construction finishing on this tick completes. Only the picking runs on
+//the thread pool, so the result does not depend on the number of threads. A shard leaves other
+//shards' plans alone.
+//As in a serial run, a plan with nothing to pick stops the tick after the plans before it have
+//started building: it and the plans after it keep waiting, nothing completes and its error is
+//thrown. stopPlan >= 0 stops the tick at that plan the same way, without an error
+void Simulation::runTick(long long tick, long long lastTick, int stopPlan){
+    TraceSpan span(*trace, "Simulation::runTick", nullptr, tick);
+    ConstructionTable &constructions = this->constructions.write();
+    const FacilityCatalog &facilitiesOptions = *this->facilitiesOptions;
+    int planId;
+    while (scheduler.popWakeup(tick, planId)) {
+        scheduler.markReady(planId);
+    }
 
-        else if (arguments[0] == "settlement") {
-            addAction(new AddSettlement(arguments[1], stoi(arguments[2]))->act(*this));
+    if (!facilitiesOptions.empty()) {
+        scheduler.takeReady(readyPlans);
+        if (shard) {
+            readyPlans.erase(remove_if(readyPlans.begin(), readyPlans.end(), [this](int planId) {
+                return !ownsPlan(planId);
+            }), readyPlans.end());
+        }
+        if (!cycleDetectors.empty()) {
+            skipCycles(tick, lastTick);
         }
-        
-        else if (arguments[0] == "facility") {
-            addAction(new AddFacility(arguments[1], stoi(arguments[2]), stoi(arguments[3]), stoi(arguments[4]), stoi(arguments[5]), stoi(arguments[6]))->act(*this));
+        auto stop = readyPlans.begin();
+        while (stop != readyPlans.end() && (stopPlan < 0 || *stop < stopPlan) && plans[*stop]->canSelect(facilitiesOptions)) {
+            ++stop;
         }
-        
-        else if (arguments[0] == "planStatus") {
-           addAction(new PrintStatus(arguments[1])->act(*this));
+        const vector<int> waitingPlans(stop, readyPlans.end());
+        readyPlans.erase(stop, readyPlans.end());
+        for (int planId : waitingPlans) {
+            scheduler.markReady(planId);
+        }
+        try {
+            selectFacilities(readyPlans);
+        } catch (...) {
+            for (int planId : readyPlans) {
+                scheduler.markReady(planId);
+            }
+            throw;
         }
 
-        else if (arguments[0] == "changePolicy") {
-            addAction(new ChangePlanPolicy(stoi(arguments[1]), arguments[2])->act(*this));
+        const int rowsBefore = constructions.size();
+        for (int planId : readyPlans) {
+            const int firstRow = constructions.size();
+            {
+                TraceSpan span(*trace, "Plan::step", nullptr, planId);
+                writePlan(planId).step(constructions, facilitiesOptions.getTypes(), tick);
+            }
+            for (int row = firstRow; row < constructions.size(); ++row) {
+                scheduler.scheduleCompletion(constructions.getFinishTick(row), planId);
+            }
+        }
+        if (stats->isEnabled()) {
+            stats->recordFacilities(constructions.size() - rowsBefore, 0);
         }
 
-        else if (arguments[0] == "log") {
-            addAction(new PrintActionsLog()->act(*this));
-            
+        if (!waitingPlans.empty() && (stopPlan < 0 || waitingPlans.front() < stopPlan)) {
+            failedPlan = waitingPlans.front();
+            writePlan(failedPlan).selectFacilities(facilitiesOptions); //throws the policy's own error
         }
+    }
+    if (stopPlan >= 0) {
+        return;
+    }
 
-        else if (arguments[0] == "backup") {
-            addAction(new BackupSimulation()->act(*this));
+    while (scheduler.popCompletion(tick, planId)) {
+        if (!ownsPlan(planId)) {
+            continue;
+        }
+        FixedVector<int, MAX_CONSTRUCTION_LIMIT> finishedRows;
+        Plan &plan = writePlan(planId);
+        plan.collectCompleted(constructions, tick, finishedRows);
+        if (finishedRows.empty()) {
+            continue; //another event of this plan already collected everything finishing now
         }
 
-        else if (arguments[0] == "restore") {
-            addAction(new RestoreSimulation()->act(*this));
+        //Highest row first, so removing one row never moves another finished row
+        for (int i = 1; i < finishedRows.size(); ++i) {
+            for (int j = i; j > 0 && finishedRows[j - 1] < finishedRows[j]; --j) {
+                swap(finishedRows[j - 1], finishedRows[j]);
+            }
         }
+        if (stats->isEnabled()) {
+            stats->recordFacilities(0, finishedRows.size());
+        }
+        for (int row : finishedRows) {
+            if (undoTarget.record) {
+                undoTarget.record->keepRow(constructions, row);
+                undoTarget.record->keepRow(constructions, constructions.size() - 1);
+            }
+            const int movedPlan = constructions.remove(row);
+            if (movedPlan >= 0) {
+                writePlan(movedPlan).relocateConstruction(constructions.size(), row);
+            }
+        }
+        scheduler.markReady(planId);
+    }
+}
+
+//A failing plan does not stop the others; the lowest failing plan id is reported, as a serial run would
+void Simulation::selectFacilities(const vector<int> &planIds) {
+    const int planCount = static_cast<int>(planIds.size());
+    mutex failureLock;
+    int failedPlan = plans.size();
+    exception_ptr failure;
 
-        else if (arguments[0] == "close") {
-            addAction(new CloseSimulation()->act(*this));
+    //Unshare the plans up front; the workers must not copy them
+    for (int planId : planIds) {
+        writePlan(planId);
+    }
+    const FacilityCatalog &facilityOptions = *facilitiesOptions;
+    const bool timed = stats->isEnabled();
+
+    //Timed calls are counted per range and added to the stats once, under the lock
+    auto selectRange = [&](int first, int last) {
+        long long calls[SelectionPolicy::KINDS] = {};
+        long long picks[SelectionPolicy::KINDS] = {};
+        long long nanoseconds[SelectionPolicy::KINDS] = {};
+        for (int i = first; i < last; ++i) {
+            Plan &plan = *plans[planIds[i]];
+            const int kind = plan.getSelectionPolicy().getKind();
+            const chrono::steady_clock::time_point started = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+            try {
+                TraceSpan span(*trace, "Plan::selectFacilities", SelectionPolicy::getKindName(kind), planIds[i]);
+                const int picked = plan.selectFacilities(facilityOptions);
+                if (timed) {
+                    calls[kind]++;
+                    picks[kind] += picked;
+                }
+            } catch (...) {
+                lock_guard<mutex> guard(failureLock);
+                if (planIds[i] < failedPlan) {
+                    failedPlan = planIds[i];
+                    failure = current_exception();
+                }
+            }
+            if (timed) {
+                nanoseconds[kind] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - started).count();
+            }
         }
-    
-        else {
-            cout << "Invalid command\n";
+        if (timed) {
+            lock_guard<mutex> guard(failureLock);
+            for (int kind = 0; kind < SelectionPolicy::KINDS; ++kind) {
+                stats->recordSelection(kind, calls[kind], picks[kind], nanoseconds[kind]);
+            }
         }
+    };
+
+    if (threadPool) {
+        threadPool->parallelFor(0, planCount, SELECTION_GRAIN, selectRange);
+    } else {
+        selectRange(0, planCount);
+    }
+
+    if (failure) {
+        this->failedPlan = failedPlan;
+        rethrow_exception(failure);
+    }
 }
 
-//add a plan to the simulation
-void Simulation::addPlan(const Settlement &settlement, SelectionPolicy *selectionPolicy){
-    Plan newPlan = Plan(planCounter, settlement, selectionPolicy, facilitiesOptions);
-    plans.push_back(newPlan);
-    planCounter++;  
+//A shard prints the plans it owns, each as a section the coordinator puts back in order
+void Simulation::close() {
+    isRunning = false;
+
+    TextWriter out(cout.rdbuf());
+    for(int planId = 0; planId < plans.size(); ++planId){
+        if (!ownsPlan(planId)) {
+            continue;
+        }
+        plans[planId]->render(out, facilitiesOptions->getTypes());
+        out << '\n';
+        if (shard) {
+            out.flush();
+            shard->endSection();
+        }
+    }
 }
 
-// Add an action to the ActionLog
-void Simulation::addAction(BaseAction *action){
-    actionsLog.push_back(action);
+void Simulation::open() {
+    isRunning = true;
 }
 
+//Writes the whole state; see Snapshot.h for the layout
+void Simulation::saveSnapshot(const string &path) const {
+    if (shard) {
+        throw runtime_error("A sharded simulation cannot be saved");
+    }
+    SnapshotWriter writer;
+    writer.writeI32(planCounter);
+    writer.writeI64(currentTick);
+
+    writer.writeI32(settlements.size());
+    for (int i = 0; i < settlements.size(); ++i) {
+        writer.writeString(settlements[i]->getName());
+        writer.writeU8(static_cast<uint8_t>(settlements[i]->getType()));
+    }
 
-bool Simulation::addSettlement(Settlement *settlement){
-    if(isSettlementExists(settlement->getName())){
-        return false;
+    writer.writeI32(facilitiesOptions->size());
+    for (const FacilityType &facility : facilitiesOptions->getTypes()) {
+        writer.writeString(facility.getName());
+        writer.writeU8(static_cast<uint8_t>(facility.getCategory()));
+        writer.writeI32(facility.getCost());
+        writer.writeI32(facility.getLifeQualityScore());
+        writer.writeI32(facility.getEconomyScore());
+        writer.writeI32(facility.getEnvironmentScore());
     }
-    else{
-        settlements.push_back(settlement);
-        return true;
+
+    writer.writeI32(static_cast<int32_t>(policyDefinitions->size()));
+    for (const shared_ptr<const WeightedPolicy> &definition : *policyDefinitions) {
+        writer.writeString(definition->getName());
+        writer.writeString(definition->getDefinition());
     }
+
+    //Only the text of logged actions is kept
+    writer.writeI32(actionsLog.size());
+    actionsLog.forEachLine([&writer](string_view line) {
+        writer.writeString(string(line));
+    });
+
+    constructions->save(writer);
+    scheduler.save(writer);
+    for (int planId = 0; planId < plans.size(); ++planId) {
+        plans[planId]->save(writer);
+    }
+
+    writer.writeTo(path);
 }
 
-bool Simualtion::addFacility(FacilityType facility){
-    for (const auto &facilityOption : facilitiesOptions) {
-        if (facilityOption.getName() == facility.getName()) {
-            return false;
+//Replaces the whole state with the one saved in path. Everything is read and checked before any
+//of it is installed, so a bad file leaves the simulation as it was
+void Simulation::loadSnapshot(const string &path) {
+    SnapshotReader reader(path);
+    const int loadedPlanCounter = reader.readCount(INT32_MAX);
+    const long long loadedTick = reader.readI64();
+    if (loadedTick < 0) {
+        reader.fail("bad tick");
+    }
+
+    ChunkedVector<shared_ptr<Settlement>> loadedSettlements;
+    const int settlementCount = reader.readCount(INT32_MAX, sizeof(int32_t) + sizeof(uint8_t));
+    for (int i = 0; i < settlementCount; ++i) {
+        const string name = reader.readString();
+        const uint8_t type = reader.readU8();
+        if (type > static_cast<uint8_t>(SettlementType::METROPOLIS)) {
+            reader.fail("bad settlement type");
         }
+        loadedSettlements.push_back(make_shared<Settlement>(name, static_cast<SettlementType>(type)));
     }
-    facilitiesOptions.push_back(move(facility));
-    return true;
-}
 
-bool isSettlementExists(const string &settlementName){
-    for (Settlement* settlement : settlements) {
-        if (settlement->getName() == settlementName) {
-            return true;
+    CowPtr<FacilityCatalog> loadedOptions;
+    FacilityCatalog &options = loadedOptions.write();
+    const int facilityCount = reader.readCount(INT32_MAX, sizeof(int32_t) + sizeof(uint8_t) + 4 * sizeof(int32_t));
+    options.reserve(facilityCount);
+    for (int i = 0; i < facilityCount; ++i) {
+        const string name = reader.readString();
+        const uint8_t category = reader.readU8();
+        if (category > static_cast<uint8_t>(FacilityCategory::ENVIRONMENT)) {
+            reader.fail("bad facility category");
         }
+        const int price = reader.readI32();
+        const int lifeQualityScore = reader.readI32();
+        const int economyScore = reader.readI32();
+        const int environmentScore = reader.readI32();
+        options.add(FacilityType(name, static_cast<FacilityCategory>(category), price, lifeQualityScore, economyScore, environmentScore));
     }
-    return false;
-}
 
-Settlement &getSettlement(const string &settlementName){
-    for (Setllemnt* settlement : settlements) {
-        if (settlement->getName() == settlementName) {
-            return *settlement;
+    CowPtr<vector<shared_ptr<const WeightedPolicy>>> loadedDefinitions;
+    const int definitionCount = reader.readCount(INT32_MAX, 2 * sizeof(int32_t));
+    for (int i = 0; i < definitionCount; ++i) {
+        const string name = reader.readString();
+        const string definition = reader.readString();
+        try {
+            loadedDefinitions.write().push_back(make_shared<const WeightedPolicy>(name, definition));
+        } catch (const runtime_error &) {
+            reader.fail("bad policy definition");
         }
     }
-}
 
-Plan Simualtion::&getPlan(const int planID){
-    for (const auto &plan : plans) {
-        if (plan.getPlanID() == planID) {
-            return plan;
+    //Keeps this log's limit and spill file; a line break would split a line once spilled
+    ActionLog loadedLog = actionsLog;
+    loadedLog.clear();
+    const int actionCount = reader.readCount(INT32_MAX, sizeof(int32_t));
+    for (int i = 0; i < actionCount; ++i) {
+        const string line = reader.readString();
+        if (line.find('\n') != string::npos) {
+            reader.fail("bad log line");
         }
+        loadedLog.appendLine(line);
     }
-}
 
-int Simulation::getPlanCounter() const {
-    return planCounter;
-}
+    CowPtr<ConstructionTable> loadedConstructions;
+    loadedConstructions.write().load(reader, loadedPlanCounter, facilityCount);
+    ConstructionScheduler loadedScheduler;
+    loadedScheduler.load(reader, loadedPlanCounter);
 
-vector<BaseAction *> Simulation::getActionsLog() const {
-    return actionsLog;
-}
+    ChunkedVector<shared_ptr<Plan>> loadedPlans;
+    for (int i = 0; i < loadedPlanCounter; ++i) {
+        loadedPlans.push_back(Plan::load(reader, loadedSettlements, options, *loadedDefinitions, *loadedConstructions));
+        if (loadedPlans.back()->getPlanId() != i) {
+            reader.fail("bad plan id");
+        }
+    }
+    if (!reader.atEnd()) {
+        reader.fail("trailing data");
+    }
 
-void Simulation::step(){
-    for (auto &plan : plans) {
-        plan.step();
+    NameIndex loadedSettlementIndex;
+    for (int i = 0; i < loadedSettlements.size(); ++i) {
+        loadedSettlementIndex.add(loadedSettlements[i]->getName(), i);
+    }
+    NameIndex loadedFacilityIndex;
+    for (int i = 0; i < facilityCount; ++i) {
+        loadedFacilityIndex.add(options[i].getName(), i);
     }
-}
 
-void Simulation::close() {
-    isRunning = false;
+    planCounter = loadedPlanCounter;
+    currentTick = loadedTick;
+    actionsLog = loadedLog;
+    plans = loadedPlans;
+    settlements = loadedSettlements;
+    facilitiesOptions = loadedOptions;
+    policyDefinitions = loadedDefinitions;
+    settlementIndex = loadedSettlementIndex;
+    facilityIndex = loadedFacilityIndex;
+    constructions = loadedConstructions;
+    scheduler = loadedScheduler;
+}
 
-    for(Plan plan : plans){
-        plan.printStatus();
+void Simulation::startUndoRecord(const shared_ptr<UndoRecord> &record, bool replacing) {
+    if (undoTarget.record) {
+        undoTarget.record->finish();
+        undoTarget.record.reset();
     }
+    if (replacing) {
+        record->previous = make_shared<const Simulation>(*this);
+        record->previousBytes = static_cast<size_t>(constructions->size()) * sizeof(ConstructionTable::Row);
+        for (int planId = 0; planId < plans.size(); planId++) {
+            record->previousBytes += sizeof(Plan) + static_cast<size_t>(plans[planId]->getFacilities().size()) * sizeof(Facility);
+        }
+        return;
+    }
+    record->planCounter = planCounter;
+    record->currentTick = currentTick;
+    record->failedTick = failedTick;
+    record->failedPlan = failedPlan;
+    record->settlementCount = settlements.size();
+    record->facilityCount = facilitiesOptions->size();
+    record->policyCount = static_cast<int>(policyDefinitions->size());
+    record->constructionCount = constructions->size();
+    record->actionsLog = actionsLog.withoutIndex();
+    record->scheduler = scheduler.getUndoState();
+    undoTarget.record = record;
 }
 
-void Simulation::open() {
-    isRunning = true;
+//Lists that only grow are cut back to their old length, along with their name indexes, then the
+//plans and rows the record kept are put back over the ones the action changed
+void Simulation::undo(const UndoRecord &record) {
+    if (undoTarget.record) {
+        undoTarget.record->finish();
+        undoTarget.record.reset();
+    }
+    if (record.previous) {
+        *this = *record.previous;
+        return;
+    }
+    planCounter = record.planCounter;
+    currentTick = record.currentTick;
+    failedTick = record.failedTick;
+    failedPlan = record.failedPlan;
+    actionsLog = record.actionsLog;
+    actionsLog.rebuildIndex();
+    while (plans.size() > record.planCounter) {
+        plans.pop_back();
+    }
+    for (const pair<int, Plan::UndoState> &kept : record.plans) {
+        writePlan(kept.first).restore(kept.second);
+    }
+    while (settlements.size() > record.settlementCount) {
+        settlements.pop_back();
+    }
+    settlementIndex.truncate(record.settlementCount);
+    if (facilitiesOptions->size() > record.facilityCount) {
+        facilitiesOptions.write().truncate(record.facilityCount);
+    }
+    facilityIndex.truncate(record.facilityCount);
+    if (static_cast<int>(policyDefinitions->size()) > record.policyCount) {
+        policyDefinitions.write().resize(record.policyCount);
+    }
+    if (constructions->size() != record.constructionCount || !record.rows.empty()) {
+        ConstructionTable &table = constructions.write();
+        table.resize(record.constructionCount);
+        for (const pair<int, ConstructionTable::Row> &kept : record.rows) {
+            table.setRow(kept.first, kept.second);
+        }
+    }
+    scheduler.restore(record.scheduler, *constructions);
 }
-
-private:
-    bool isRunning;
-    int planCounter; // For assigning unique plan IDs
-    vector<BaseAction *> actionsLog;
-    vector<Plan> plans;
-    vector<Settlement *> settlements;
-    vector<FacilityType> facilitiesOptions;
-};
\ No newline at end of file
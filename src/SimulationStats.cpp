@@ -0,0 +1,186 @@
+#include "SimulationStats.h"
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// LatencyHistogram
+LatencyHistogram::LatencyHistogram() : counts(BUCKETS, 0), count(0), sum(0), max(0) {}
+
+//Below SUB_BUCKETS a bucket per value; above, the top SUB_BUCKET_BITS + 1 bits of the value pick
+//one of the SUB_BUCKETS buckets of its power of two
+int LatencyHistogram::bucketOf(long long nanoseconds)
+{
+    if (nanoseconds < SUB_BUCKETS)
+    {
+        return static_cast<int>(std::max(nanoseconds, 0LL));
+    }
+    const int exponent = 63 - __builtin_clzll(static_cast<unsigned long long>(nanoseconds));
+    if (exponent > MAX_EXPONENT)
+    {
+        return BUCKETS - 1;
+    }
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + static_cast<int>((nanoseconds >> (exponent - SUB_BUCKET_BITS)) - SUB_BUCKETS);
+}
+
+long long LatencyHistogram::highestIn(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    const int shift = bucket / SUB_BUCKETS - 1;
+    const long long top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(long long nanoseconds)
+{
+    counts[bucketOf(nanoseconds)]++;
+    count++;
+    sum += nanoseconds;
+    max = std::max(max, nanoseconds);
+}
+
+long long LatencyHistogram::getCount() const
+{
+    return count;
+}
+
+long long LatencyHistogram::getMean() const
+{
+    return count == 0 ? 0 : sum / count;
+}
+
+long long LatencyHistogram::getMax() const
+{
+    return max;
+}
+
+long long LatencyHistogram::getPercentile(double percentile) const
+{
+    const long long rank = std::max(1LL, static_cast<long long>(ceil(percentile / 100 * count)));
+    long long seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+        {
+            return std::min(highestIn(bucket), max);
+        }
+    }
+    return max;
+}
+
+// SimulationStats
+SimulationStats::SimulationStats() : enabled(false), totals(), lastStep(), totalsBeforeStep(), selections(), commands() {}
+
+void SimulationStats::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+}
+
+void SimulationStats::reset()
+{
+    totals = Counts();
+    lastStep = Counts();
+    totalsBeforeStep = Counts();
+    for (Selection &selection : selections)
+    {
+        selection = Selection();
+    }
+    commands.clear();
+}
+
+void SimulationStats::recordStep(long long ticks)
+{
+    totals.ticks += ticks;
+    lastStep = Counts{ticks, totals.facilitiesStarted - totalsBeforeStep.facilitiesStarted, totals.facilitiesCompleted - totalsBeforeStep.facilitiesCompleted};
+    totalsBeforeStep = totals;
+}
+
+void SimulationStats::recordFacilities(long long started, long long completed)
+{
+    totals.facilitiesStarted += started;
+    totals.facilitiesCompleted += completed;
+}
+
+void SimulationStats::recordSelection(int policyKind, long long calls, long long picks, long long nanoseconds)
+{
+    selections[policyKind].calls += calls;
+    selections[policyKind].picks += picks;
+    selections[policyKind].nanoseconds += nanoseconds;
+}
+
+//There are only as many histograms as command names, so a scan finds the right one quickly
+void SimulationStats::recordCommand(string_view command, long long nanoseconds)
+{
+    auto histogram = find_if(commands.begin(), commands.end(), [command](const pair<string, LatencyHistogram> &entry) {
+        return entry.first == command;
+    });
+    if (histogram == commands.end())
+    {
+        commands.emplace_back(string(command), LatencyHistogram());
+        histogram = commands.end() - 1;
+    }
+    histogram->second.record(nanoseconds);
+}
+
+void SimulationStats::writeText(TextWriter &out, int busyPlans, int availablePlans, int logEntries) const
+{
+    out << "Stats: " << (enabled ? "collecting" : "not collecting") << '\n';
+    out << "Total ticks: " << totals.ticks << '\n';
+    out << "Total facilities started: " << totals.facilitiesStarted << '\n';
+    out << "Total facilities completed: " << totals.facilitiesCompleted << '\n';
+    out << "Last step: " << lastStep.ticks << " ticks, " << lastStep.facilitiesStarted << " facilities started, " << lastStep.facilitiesCompleted
+        << " completed\n";
+    out << "Plans BUSY: " << busyPlans << '\n';
+    out << "Plans AVALIABLE: " << availablePlans << '\n';
+    out << "Log entries: " << logEntries << '\n';
+    for (int kind = 0; kind < SelectionPolicy::KINDS; ++kind)
+    {
+        const Selection &selection = selections[kind];
+        if (selection.calls > 0)
+        {
+            out << "Total selection " << SelectionPolicy::getKindName(kind) << ": calls " << selection.calls << ", picks " << selection.picks
+                << ", time " << selection.nanoseconds << " ns\n";
+        }
+    }
+    for (const pair<string, LatencyHistogram> &command : commands)
+    {
+        const LatencyHistogram &latency = command.second;
+        out << "Command " << command.first << ": count " << latency.getCount() << ", mean " << latency.getMean() << " ns, p50 "
+            << latency.getPercentile(50) << " ns, p90 " << latency.getPercentile(90) << " ns, p99 " << latency.getPercentile(99)
+            << " ns, max " << latency.getMax() << " ns\n";
+    }
+}
+
+//One line; names are policy kinds and command names, which need no escaping
+void SimulationStats::writeJson(TextWriter &out, int busyPlans, int availablePlans, int logEntries) const
+{
+    out << "{\"enabled\": " << (enabled ? "true" : "false") << ", \"total_ticks\": " << totals.ticks << ", \"total_facilities_started\": "
+        << totals.facilitiesStarted << ", \"total_facilities_completed\": " << totals.facilitiesCompleted << ", \"last_step\": {\"ticks\": " << lastStep.ticks
+        << ", \"facilities_started\": " << lastStep.facilitiesStarted << ", \"facilities_completed\": " << lastStep.facilitiesCompleted << "}, \"plans_busy\": " << busyPlans << ", \"plans_available\": " << availablePlans
+        << ", \"log_entries\": " << logEntries << ", \"total_selection\": {";
+    bool first = true;
+    for (int kind = 0; kind < SelectionPolicy::KINDS; ++kind)
+    {
+        const Selection &selection = selections[kind];
+        if (selection.calls > 0)
+        {
+            out << (first ? "" : ", ") << '"' << SelectionPolicy::getKindName(kind) << "\": {\"calls\": " << selection.calls << ", \"picks\": "
+                << selection.picks << ", \"ns\": " << selection.nanoseconds << '}';
+            first = false;
+        }
+    }
+    out << "}, \"commands\": {";
+    first = true;
+    for (const pair<string, LatencyHistogram> &command : commands)
+    {
+        const LatencyHistogram &latency = command.second;
+        out << (first ? "" : ", ") << '"' << command.first << "\": {\"count\": " << latency.getCount() << ", \"mean_ns\": " << latency.getMean()
+            << ", \"p50_ns\": " << latency.getPercentile(50) << ", \"p90_ns\": " << latency.getPercentile(90) << ", \"p99_ns\": "
+            << latency.getPercentile(99) << ", \"max_ns\": " << latency.getMax() << '}';
+        first = false;
+    }
+    out << "}}\n";
+}
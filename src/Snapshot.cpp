@@ -0,0 +1,180 @@
+#include "Snapshot.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+static const char SNAPSHOT_MAGIC[8] = {'S', 'K', 'S', 'N', 'A', 'P', '\0', '\0'};
+
+// SnapshotWriter
+SnapshotWriter::SnapshotWriter() : buffer()
+{
+    append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    writeI32(SNAPSHOT_VERSION);
+}
+
+void SnapshotWriter::writeU8(uint8_t value)
+{
+    append(&value, sizeof(value));
+}
+
+void SnapshotWriter::writeI32(int32_t value)
+{
+    appendLittleEndian(static_cast<uint32_t>(value), sizeof(value));
+}
+
+void SnapshotWriter::writeI64(int64_t value)
+{
+    appendLittleEndian(static_cast<uint64_t>(value), sizeof(value));
+}
+
+void SnapshotWriter::writeString(const string &value)
+{
+    writeI32(static_cast<int32_t>(value.size()));
+    append(value.data(), value.size());
+}
+
+void SnapshotWriter::writeTo(const string &path) const
+{
+    ofstream file(path, ios::binary | ios::trunc);
+    if (!file.is_open())
+    {
+        throw runtime_error("Could not open snapshot file: " + path);
+    }
+    file.write(buffer.data(), buffer.size());
+    if (!file)
+    {
+        throw runtime_error("Could not write snapshot file: " + path);
+    }
+}
+
+void SnapshotWriter::append(const void *bytes, size_t size)
+{
+    buffer.append(static_cast<const char *>(bytes), size);
+}
+
+//Lowest byte first whatever the host's byte order, so files move between machines
+void SnapshotWriter::appendLittleEndian(uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        buffer.push_back(static_cast<char>(value >> (8 * i)));
+    }
+}
+
+// SnapshotReader
+SnapshotReader::SnapshotReader(const string &path) : path(path), data(nullptr), size(0), offset(0)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw runtime_error("Could not open snapshot file: " + path);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        throw runtime_error("Invalid snapshot file: " + path);
+    }
+    size = static_cast<size_t>(info.st_size);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw runtime_error("Could not map snapshot file: " + path);
+    }
+    data = static_cast<const unsigned char *>(mapping);
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    if (size < sizeof(magic) + sizeof(int32_t))
+    {
+        munmap(const_cast<unsigned char *>(data), size);
+        throw runtime_error("Invalid snapshot file: " + path);
+    }
+    read(magic, sizeof(magic));
+    const int32_t version = readI32();
+    if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || version != static_cast<int32_t>(SNAPSHOT_VERSION))
+    {
+        munmap(const_cast<unsigned char *>(data), size);
+        throw runtime_error("Invalid snapshot file: " + path);
+    }
+}
+
+SnapshotReader::~SnapshotReader()
+{
+    munmap(const_cast<unsigned char *>(data), size);
+}
+
+uint8_t SnapshotReader::readU8()
+{
+    uint8_t value;
+    read(&value, sizeof(value));
+    return value;
+}
+
+int32_t SnapshotReader::readI32()
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(readLittleEndian(sizeof(int32_t))));
+}
+
+int64_t SnapshotReader::readI64()
+{
+    return static_cast<int64_t>(readLittleEndian(sizeof(int64_t)));
+}
+
+string SnapshotReader::readString()
+{
+    const int length = readCount(static_cast<int>(size - offset));
+    string value(reinterpret_cast<const char *>(data + offset), length);
+    offset += length;
+    return value;
+}
+
+int SnapshotReader::readCount(int limit, size_t itemSize)
+{
+    const int32_t count = readI32();
+    if (count < 0 || count > limit || count * itemSize > size - offset)
+    {
+        fail("bad count");
+    }
+    return count;
+}
+
+bool SnapshotReader::atEnd() const
+{
+    return offset == size;
+}
+
+void SnapshotReader::fail(const string &reason) const
+{
+    throw runtime_error("Invalid snapshot file: " + path + " (" + reason + ")");
+}
+
+void SnapshotReader::read(void *bytes, size_t count)
+{
+    if (count > size - offset)
+    {
+        fail("truncated");
+    }
+    memcpy(bytes, data + offset, count);
+    offset += count;
+}
+
+uint64_t SnapshotReader::readLittleEndian(size_t count)
+{
+    if (count > size - offset)
+    {
+        fail("truncated");
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        value |= static_cast<uint64_t>(data[offset + i]) << (8 * i);
+    }
+    offset += count;
+    return value;
+}
@@ -0,0 +1,189 @@
+#include "Sweep.h"
+#include "Auxiliary.h"
+#include "Simulation.h"
+#include "TextWriter.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+using namespace std;
+
+//Non-negative whole numbers only; false for anything else
+static bool parseTicks(const string &text, int &ticks)
+{
+    return !text.empty() && text.find_first_not_of("0123456789") == string::npos && Auxiliary::parseInteger(text, ticks);
+}
+
+static vector<string> splitList(const string &text)
+{
+    vector<string> items;
+    size_t start = 0;
+    while (true)
+    {
+        const size_t comma = text.find(',', start);
+        items.push_back(text.substr(start, comma - start));
+        if (comma == string::npos)
+        {
+            return items;
+        }
+        start = comma + 1;
+    }
+}
+
+// Sweep
+Sweep::Sweep(const string &path) : path(path), variants()
+{
+    ifstream file(path);
+    if (!file)
+    {
+        throw runtime_error("Could not open sweep file: " + path);
+    }
+    string line;
+    for (int lineNumber = 1; getline(file, line); ++lineNumber)
+    {
+        vector<string> arguments = Auxiliary::parseArguments(line.substr(0, line.find('#')));
+        if (arguments.empty())
+        {
+            continue;
+        }
+        if (arguments[0] == "grid")
+        {
+            if (arguments.size() != 3)
+            {
+                fail(lineNumber, "grid takes tick counts and policies");
+            }
+            const vector<string> tickCounts = splitList(arguments[1]);
+            const vector<string> policies = splitList(arguments[2]);
+            for (const string &tickCount : tickCounts)
+            {
+                int ticks;
+                if (!parseTicks(tickCount, ticks))
+                {
+                    fail(lineNumber, "bad tick count: " + tickCount);
+                }
+                for (const string &policy : policies)
+                {
+                    variants.push_back(Variant{ticks, {policy}});
+                }
+            }
+            continue;
+        }
+        int ticks;
+        if (!parseTicks(arguments[0], ticks))
+        {
+            fail(lineNumber, "bad tick count: " + arguments[0]);
+        }
+        variants.push_back(Variant{ticks, vector<string>(arguments.begin() + 1, arguments.end())});
+    }
+}
+
+int Sweep::size() const
+{
+    return static_cast<int>(variants.size());
+}
+
+void Sweep::fail(int line, const string &reason) const
+{
+    throw runtime_error("Invalid sweep file: " + path + ", line " + to_string(line) + " (" + reason + ")");
+}
+
+//Rows are "<variant> <ticks> <plan> <settlement> <policy> <life> <economy> <environment>"
+bool Sweep::runVariant(const Simulation &base, int variantId, string &rows) const
+{
+    const Variant &variant = variants[variantId];
+    Simulation simulation = base;
+    simulation.setThreadCount(1);
+    const int planCount = simulation.getPlanCounter();
+    if (variant.policies.size() > 1 && static_cast<int>(variant.policies.size()) != planCount)
+    {
+        rows = "gives " + to_string(variant.policies.size()) + " policies to " + to_string(planCount) + " plans";
+        return false;
+    }
+    for (int planId = 0; planId < planCount && !variant.policies.empty(); ++planId)
+    {
+        const string &policyName = variant.policies[variant.policies.size() == 1 ? 0 : planId];
+        if (policyName == "*")
+        {
+            continue;
+        }
+        //As changePolicy does, a new bal policy starts from the plan's scores
+        Plan &plan = simulation.getPlan(planId);
+        SelectionPolicy policy;
+        if (!simulation.createSelectionPolicy(policyName, policy, plan.getlifeQualityScore(), plan.getEconomyScore(), plan.getEnvironmentScore()))
+        {
+            rows = "invalid selection policy: " + policyName;
+            return false;
+        }
+        plan.setSelectionPolicy(policy);
+    }
+    try
+    {
+        simulation.step(variant.ticks);
+    }
+    catch (const runtime_error &e)
+    {
+        rows = e.what();
+        return false;
+    }
+
+    //Read through a const simulation, which leaves plans no variant changed shared
+    const Simulation &finished = simulation;
+    TextWriter out(rows);
+    for (int planId = 0; planId < planCount; ++planId)
+    {
+        const Plan &plan = finished.getPlan(planId);
+        out << variantId << ' ' << variant.ticks << ' ' << planId << ' ' << plan.getSettlement().getName() << ' ' << plan.getSelectionPolicy().toString() << ' '
+            << plan.getlifeQualityScore() << ' ' << plan.getEconomyScore() << ' ' << plan.getEnvironmentScore() << '\n';
+    }
+    return true;
+}
+
+void Sweep::run(const Simulation &base, int threadCount) const
+{
+    const chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    vector<string> results(variants.size());
+    vector<char> failed(variants.size(), false);
+    auto runRange = [&](int first, int last) {
+        for (int variantId = first; variantId < last; ++variantId)
+        {
+            try
+            {
+                failed[variantId] = !runVariant(base, variantId, results[variantId]);
+            }
+            catch (const exception &e)
+            {
+                results[variantId] = e.what();
+                failed[variantId] = true;
+            }
+        }
+    };
+    if (threadCount > 1)
+    {
+        ThreadPool pool(threadCount);
+        pool.parallelFor(0, size(), 1, runRange);
+    }
+    else
+    {
+        runRange(0, size());
+    }
+    const double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    TextWriter out(cout.rdbuf());
+    out << "variant ticks plan settlement policy life economy environment\n";
+    for (int variantId = 0; variantId < size(); ++variantId)
+    {
+        if (failed[variantId])
+        {
+            out << variantId << ' ' << variants[variantId].ticks << " Error: " << results[variantId] << '\n';
+        }
+        else
+        {
+            out << results[variantId];
+        }
+    }
+    char throughput[96];
+    snprintf(throughput, sizeof(throughput), "# %d variants in %.3f s, %.1f variants per second\n", size(), seconds, seconds > 0 ? size() / seconds : 0.0);
+    out << throughput;
+}
@@ -0,0 +1,29 @@
+#include "TextWriter.h"
+using namespace std;
+
+TextWriter::TextWriter(streambuf *output) : stream(output), target(nullptr), used(0) {}
+
+TextWriter::TextWriter(string &output) : stream(nullptr), target(&output), used(0) {}
+
+TextWriter::~TextWriter()
+{
+    flush();
+}
+
+void TextWriter::flush()
+{
+    writeOut(block, used);
+    used = 0;
+}
+
+void TextWriter::writeOut(const char *text, size_t size)
+{
+    if (target != nullptr)
+    {
+        target->append(text, size);
+    }
+    else
+    {
+        stream->sputn(text, static_cast<streamsize>(size));
+    }
+}
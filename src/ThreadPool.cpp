@@ -0,0 +1,132 @@
+#include "ThreadPool.h"
+#include <algorithm>
+using namespace std;
+
+ThreadPool::ThreadPool(int threadCount)
+    : threads(), queues(), body(nullptr), pending(0), sleepLock(), wake(), generation(0), stopping(false)
+{
+    const int participants = max(1, threadCount);
+    for (int i = 0; i < participants; ++i)
+    {
+        queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+    }
+    for (int i = 1; i < participants; ++i)
+    {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread &worker : threads)
+    {
+        worker.join();
+    }
+}
+
+int ThreadPool::getThreadCount() const
+{
+    return static_cast<int>(queues.size());
+}
+
+void ThreadPool::parallelFor(int begin, int end, int grain, const function<void(int, int)> &body)
+{
+    if (begin >= end)
+    {
+        return;
+    }
+    grain = max(1, grain);
+    if (threads.empty() || end - begin <= grain)
+    {
+        body(begin, end);
+        return;
+    }
+
+    //The count goes up before any task is queued: a worker still in runTasks from the last call may
+    //take and finish a new task right away, and its fetch_sub must not be overwritten
+    this->body = &body;
+    pending.store((end - begin + grain - 1) / grain);
+    int chunks = 0;
+    for (int first = begin; first < end; first += grain)
+    {
+        WorkQueue &queue = *queues[chunks % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(Task{first, min(end, first + grain)});
+        chunks++;
+    }
+
+    {
+        lock_guard<mutex> guard(sleepLock);
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(0);
+    while (pending.load() > 0)
+    {
+        this_thread::yield();
+    }
+    this->body = nullptr;
+}
+
+void ThreadPool::workerLoop(int self)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            unique_lock<mutex> guard(sleepLock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+        runTasks(self);
+    }
+}
+
+void ThreadPool::runTasks(int self)
+{
+    Task task;
+    while (takeTask(self, task))
+    {
+        (*body)(task.begin, task.end);
+        pending.fetch_sub(1);
+    }
+}
+
+//Own deque first (newest chunk, still warm in cache), then steal the oldest chunk of another worker
+bool ThreadPool::takeTask(int self, Task &task)
+{
+    {
+        WorkQueue &own = *queues[self];
+        lock_guard<mutex> guard(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    const int count = static_cast<int>(queues.size());
+    for (int offset = 1; offset < count; ++offset)
+    {
+        WorkQueue &victim = *queues[(self + offset) % count];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,166 @@
+#include "Trace.h"
+#include "TextWriter.h"
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+using namespace std;
+
+static atomic<long long> recorderCount(0);
+
+//Microseconds, as the trace format wants them, to the nanosecond
+static void writeMicroseconds(TextWriter &out, long long nanoseconds)
+{
+    const int fraction = static_cast<int>(nanoseconds % 1000);
+    out << nanoseconds / 1000 << '.' << static_cast<char>('0' + fraction / 100) << static_cast<char>('0' + fraction / 10 % 10) << static_cast<char>('0' + fraction % 10);
+}
+
+// TraceRecorder
+TraceRecorder::TraceRecorder() : id(recorderCount.fetch_add(1)), enabled(false), path("trace.json"), epoch(chrono::steady_clock::now()), registration(), buffers() {}
+
+TraceRecorder::~TraceRecorder() = default;
+
+//The thread turning tracing on is the one running the commands; registering it here makes it the
+//first, named main in the trace, although workers finish their spans before it does
+void TraceRecorder::setEnabled(bool enabled)
+{
+    this->enabled = enabled;
+    if (enabled)
+    {
+        localBuffer();
+    }
+}
+
+const string &TraceRecorder::getPath() const
+{
+    return path;
+}
+
+void TraceRecorder::setPath(const string &path)
+{
+    this->path = path;
+}
+
+bool TraceRecorder::empty() const
+{
+    for (const unique_ptr<ThreadBuffer> &buffer : buffers)
+    {
+        if (buffer->count > 0 || buffer->dropped > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+long long TraceRecorder::now() const
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+//The last buffer used is remembered per thread, so only a thread's first span, or its first after
+//recording for another recorder, takes the lock
+TraceRecorder::ThreadBuffer &TraceRecorder::localBuffer()
+{
+    thread_local long long cachedRecorder = -1;
+    thread_local ThreadBuffer *cachedBuffer = nullptr;
+    if (cachedRecorder != id)
+    {
+        lock_guard<mutex> guard(registration);
+        const thread::id self = this_thread::get_id();
+        cachedBuffer = nullptr;
+        for (const unique_ptr<ThreadBuffer> &buffer : buffers)
+        {
+            if (buffer->thread == self)
+            {
+                cachedBuffer = buffer.get();
+            }
+        }
+        if (cachedBuffer == nullptr)
+        {
+            buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer{self, {}, 0, 0}));
+            cachedBuffer = buffers.back().get();
+        }
+        cachedRecorder = id;
+    }
+    return *cachedBuffer;
+}
+
+void TraceRecorder::record(string_view name, const char *detail, long long value, long long start)
+{
+    const long long end = now();
+    ThreadBuffer &buffer = localBuffer();
+    if (buffer.count >= MAX_THREAD_EVENTS)
+    {
+        buffer.dropped++;
+        return;
+    }
+    if (buffer.count == static_cast<long long>(buffer.blocks.size()) * BLOCK_EVENTS)
+    {
+        buffer.blocks.emplace_back(new TraceEvent[BLOCK_EVENTS]);
+    }
+    buffer.blocks[buffer.count / BLOCK_EVENTS][buffer.count % BLOCK_EVENTS] = TraceEvent{name, detail, value, start, end - start};
+    buffer.count++;
+}
+
+//Names and details are identifiers, so they are written without escaping
+void TraceRecorder::dump(const string &path)
+{
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error("Could not open trace file: " + path);
+    }
+    long long dropped = 0;
+    {
+        TextWriter out(file.rdbuf());
+        out << "{\"traceEvents\": [\n";
+        bool first = true;
+        for (size_t thread = 0; thread < buffers.size(); ++thread)
+        {
+            ThreadBuffer &buffer = *buffers[thread];
+            const int tid = static_cast<int>(thread) + 1;
+            out << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": {\"name\": \"";
+            if (thread == 0)
+            {
+                out << "main";
+            }
+            else
+            {
+                out << "thread " << tid;
+            }
+            out << "\"}}";
+            first = false;
+            for (long long i = 0; i < buffer.count; ++i)
+            {
+                const TraceEvent &event = buffer.blocks[i / BLOCK_EVENTS][i % BLOCK_EVENTS];
+                out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid << ", \"ts\": ";
+                writeMicroseconds(out, event.start);
+                out << ", \"dur\": ";
+                writeMicroseconds(out, event.duration);
+                if (event.detail != nullptr || event.value >= 0)
+                {
+                    out << ", \"args\": {";
+                    if (event.detail != nullptr)
+                    {
+                        out << "\"detail\": \"" << event.detail << '"' << (event.value >= 0 ? ", " : "");
+                    }
+                    if (event.value >= 0)
+                    {
+                        out << "\"value\": " << event.value;
+                    }
+                    out << '}';
+                }
+                out << '}';
+            }
+            dropped += buffer.dropped;
+            buffer.blocks.clear();
+            buffer.count = 0;
+            buffer.dropped = 0;
+        }
+        out << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped_events\": " << dropped << "}}\n";
+    }
+    if (!file.flush())
+    {
+        throw runtime_error("Could not write trace file: " + path);
+    }
+}
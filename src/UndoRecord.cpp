@@ -0,0 +1,54 @@
+#include "UndoRecord.h"
+using namespace std;
+
+UndoRecord::UndoRecord()
+    : previous(), previousBytes(0), planCounter(0), currentTick(0), failedTick(-1), failedPlan(0), settlementCount(0), facilityCount(0), policyCount(0), constructionCount(0),
+      actionsLog(), scheduler(), plans(), rows(), keptPlans(), keptRows() {}
+
+void UndoRecord::keepPlan(int planId, const Plan &plan)
+{
+    if (planId >= planCounter)
+    {
+        return;
+    }
+    if (keptPlans.empty())
+    {
+        keptPlans.assign(planCounter, false);
+    }
+    if (!keptPlans[planId])
+    {
+        keptPlans[planId] = true;
+        plans.emplace_back(planId, plan.getUndoState());
+    }
+}
+
+void UndoRecord::keepRow(const ConstructionTable &constructions, int row)
+{
+    if (row >= constructionCount)
+    {
+        return;
+    }
+    if (keptRows.empty())
+    {
+        keptRows.assign(constructionCount, false);
+    }
+    if (!keptRows[row])
+    {
+        keptRows[row] = true;
+        rows.emplace_back(row, constructions.getRow(row));
+    }
+}
+
+void UndoRecord::finish()
+{
+    vector<bool>().swap(keptPlans);
+    vector<bool>().swap(keptRows);
+    plans.shrink_to_fit();
+    rows.shrink_to_fit();
+}
+
+size_t UndoRecord::getBytes() const
+{
+    return sizeof(UndoRecord) + previousBytes + plans.capacity() * sizeof(plans[0]) + rows.capacity() * sizeof(rows[0])
+        + scheduler.readyPlans->capacity() * sizeof(int);
+}
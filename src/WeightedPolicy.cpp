@@ -0,0 +1,308 @@
+#include "WeightedPolicy.h"
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+using namespace std;
+
+//Bound on every number written in a definition
+static const long long MAX_DEFINITION_NUMBER = 1000000;
+//Bound on the compiled weights and the fractions they come from; see findHighestWeighted
+static const __int128 MAX_WEIGHT = static_cast<__int128>(1) << 62;
+
+static const char *const SCORE_NAMES[FacilityCatalog::SCORE_COLUMNS] = {"life", "eco", "env", "price"};
+
+// Splits a definition into numbers, words and the operators + - * /
+class DefinitionTokens
+{
+    public:
+        enum Kind
+        {
+            NUMBER,
+            WORD,
+            SYMBOL,
+            END,
+        };
+
+        explicit DefinitionTokens(string_view text) : text(text), position(0), kind(END), word(), number(0)
+        {
+            advance();
+        }
+
+        Kind getKind() const { return kind; }
+        string_view getWord() const { return word; }
+        long long getNumber() const { return number; }
+        bool isSymbol(char symbol) const { return kind == SYMBOL && word[0] == symbol; }
+
+        void advance()
+        {
+            while (position < text.size() && isspace(static_cast<unsigned char>(text[position])))
+            {
+                position++;
+            }
+            const size_t start = position;
+            if (position == text.size())
+            {
+                kind = END;
+                word = string_view();
+                return;
+            }
+            if (isdigit(static_cast<unsigned char>(text[position])))
+            {
+                kind = NUMBER;
+                number = 0;
+                while (position < text.size() && isdigit(static_cast<unsigned char>(text[position])))
+                {
+                    number = min(number * 10 + (text[position] - '0'), MAX_DEFINITION_NUMBER + 1);
+                    position++;
+                }
+                if (number > MAX_DEFINITION_NUMBER)
+                {
+                    throw runtime_error("number too large: " + string(text.substr(start, position - start)));
+                }
+            }
+            else if (isalpha(static_cast<unsigned char>(text[position])))
+            {
+                kind = WORD;
+                while (position < text.size() && isalnum(static_cast<unsigned char>(text[position])))
+                {
+                    position++;
+                }
+            }
+            else if (string_view("+-*/").find(text[position]) != string_view::npos)
+            {
+                kind = SYMBOL;
+                position++;
+            }
+            else
+            {
+                throw runtime_error("unexpected character: " + string(1, text[position]));
+            }
+            word = text.substr(start, position - start);
+        }
+
+    private:
+        string_view text;
+        size_t position;
+        Kind kind;
+        string_view word;
+        long long number;
+};
+
+static __int128 greatestCommonDivisor(__int128 a, __int128 b)
+{
+    a = a < 0 ? -a : a;
+    while (b != 0)
+    {
+        const __int128 rest = a % b;
+        a = b;
+        b = rest;
+    }
+    return a;
+}
+
+// A weight while the expression is read, kept exact as a fraction in lowest terms
+struct Fraction
+{
+    __int128 numerator;
+    __int128 denominator;
+
+    void add(__int128 otherNumerator, __int128 otherDenominator)
+    {
+        numerator = numerator * otherDenominator + otherNumerator * denominator;
+        denominator *= otherDenominator;
+        const __int128 divisor = greatestCommonDivisor(numerator, denominator);
+        if (divisor > 1)
+        {
+            numerator /= divisor;
+            denominator /= divisor;
+        }
+        if (numerator >= MAX_WEIGHT || -numerator >= MAX_WEIGHT || denominator >= MAX_WEIGHT)
+        {
+            throw runtime_error("weights too large");
+        }
+    }
+};
+
+static int findScore(string_view word)
+{
+    for (int column = 0; column < FacilityCatalog::SCORE_COLUMNS; ++column)
+    {
+        if (word == SCORE_NAMES[column])
+        {
+            return column;
+        }
+    }
+    return -1;
+}
+
+//A category as written on facility lines, or named after its score
+static int findCategory(const DefinitionTokens &tokens)
+{
+    if (tokens.getKind() == DefinitionTokens::NUMBER && tokens.getNumber() <= 2)
+    {
+        return static_cast<int>(tokens.getNumber());
+    }
+    const int score = tokens.getKind() == DefinitionTokens::WORD ? findScore(tokens.getWord()) : -1;
+    return score >= 0 && score < 3 ? score : -1;
+}
+
+// WeightedPolicy
+WeightedPolicy::WeightedPolicy(const string &name, const string &definition)
+    : name(name), definition(definition), weights(), allowed()
+{
+    try
+    {
+        compile();
+    }
+    catch (const runtime_error &e)
+    {
+        throw runtime_error("Invalid policy definition: " + string(e.what()));
+    }
+}
+
+const string &WeightedPolicy::getName() const
+{
+    return name;
+}
+
+const string &WeightedPolicy::getDefinition() const
+{
+    return definition;
+}
+
+int WeightedPolicy::findBest(const FacilityCatalog &facilitiesOptions, int first, int best) const
+{
+    return facilitiesOptions.findHighestWeighted(weights, allowed, first, best);
+}
+
+bool WeightedPolicy::canSelect(const FacilityCatalog &facilitiesOptions) const
+{
+    for (int category = 0; category < 3; ++category)
+    {
+        if (allowed[category] && !facilitiesOptions.getPositions(static_cast<FacilityCategory>(category)).empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// expression := [+|-] term {(+|-) term}, term := factor {(*|/) factor} with exactly one score among
+// the factors and only numbers after /. The fractions are brought to a common denominator, which
+// scales every weight by the same positive amount and so keeps the order of the sums
+void WeightedPolicy::compile()
+{
+    Fraction fractions[FacilityCatalog::SCORE_COLUMNS];
+    for (Fraction &fraction : fractions)
+    {
+        fraction = Fraction{0, 1};
+    }
+
+    DefinitionTokens tokens(definition);
+    int sign = 1;
+    if (tokens.isSymbol('+') || tokens.isSymbol('-'))
+    {
+        sign = tokens.isSymbol('-') ? -1 : 1;
+        tokens.advance();
+    }
+    while (true)
+    {
+        int score = -1;
+        __int128 numerator = sign;
+        __int128 denominator = 1;
+        bool divides = false;
+        while (true)
+        {
+            if (tokens.getKind() == DefinitionTokens::NUMBER)
+            {
+                if (divides && tokens.getNumber() == 0)
+                {
+                    throw runtime_error("division by zero");
+                }
+                (divides ? denominator : numerator) *= tokens.getNumber();
+            }
+            else if (tokens.getKind() == DefinitionTokens::WORD && !divides && findScore(tokens.getWord()) >= 0)
+            {
+                if (score >= 0)
+                {
+                    throw runtime_error("two scores in one term");
+                }
+                score = findScore(tokens.getWord());
+            }
+            else
+            {
+                throw runtime_error(tokens.getKind() == DefinitionTokens::END ? "expression ends early" : "unexpected " + string(tokens.getWord()));
+            }
+            if (numerator >= MAX_WEIGHT || -numerator >= MAX_WEIGHT || denominator >= MAX_WEIGHT)
+            {
+                throw runtime_error("weights too large");
+            }
+            tokens.advance();
+            if (!tokens.isSymbol('*') && !tokens.isSymbol('/'))
+            {
+                break;
+            }
+            divides = tokens.isSymbol('/');
+            tokens.advance();
+        }
+        if (score < 0)
+        {
+            throw runtime_error("term without a score");
+        }
+        fractions[score].add(numerator, denominator);
+
+        if (!tokens.isSymbol('+') && !tokens.isSymbol('-'))
+        {
+            break;
+        }
+        sign = tokens.isSymbol('-') ? -1 : 1;
+        tokens.advance();
+    }
+
+    const bool filtered = tokens.getKind() == DefinitionTokens::WORD && tokens.getWord() == "only";
+    if (filtered)
+    {
+        tokens.advance();
+    }
+    else if (tokens.getKind() != DefinitionTokens::END)
+    {
+        throw runtime_error("unexpected " + string(tokens.getWord()));
+    }
+    for (int category = 0; category < 3; ++category)
+    {
+        allowed[category] = !filtered;
+    }
+    if (filtered && tokens.getKind() == DefinitionTokens::END)
+    {
+        throw runtime_error("only needs a category");
+    }
+    while (tokens.getKind() != DefinitionTokens::END)
+    {
+        const int category = findCategory(tokens);
+        if (category < 0)
+        {
+            throw runtime_error("invalid category: " + string(tokens.getWord()));
+        }
+        allowed[category] = true;
+        tokens.advance();
+    }
+
+    __int128 commonDenominator = 1;
+    for (const Fraction &fraction : fractions)
+    {
+        commonDenominator = commonDenominator / greatestCommonDivisor(commonDenominator, fraction.denominator) * fraction.denominator;
+        if (commonDenominator >= MAX_WEIGHT)
+        {
+            throw runtime_error("weights too large");
+        }
+    }
+    for (int column = 0; column < FacilityCatalog::SCORE_COLUMNS; ++column)
+    {
+        const __int128 weight = fractions[column].numerator * (commonDenominator / fractions[column].denominator);
+        if (weight >= MAX_WEIGHT || -weight >= MAX_WEIGHT)
+        {
+            throw runtime_error("weights too large");
+        }
+        weights[column] = static_cast<long long>(weight);
+    }
+}
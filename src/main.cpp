@@ -1,21 +1,138 @@
+#include "Auxiliary.h"
 #include "Simulation.h"
+#include "ShardPool.h"
+#include "Sweep.h"
 #include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 using namespace std;
 
-Simulation* backup = nullptr;
+unordered_map<string, Simulation> backups; //Checkpoints by name; "" is the unnamed one
+deque<shared_ptr<UndoRecord>> undoJournal; //What each of the latest changing actions changed
+
+static const char *const USAGE = "usage: simulation <config_path> [--threads <count>] [--snapshot <file>] [--batch] [--script <file>] [--log-cap <count>] [--log-spill <file>] [--stats] [--trace <file>] [--sweep <file>] [--shards <count>]";
+
+//Counts given on the command line are whole numbers from 1 up
+static bool parseCount(const char *text, int &count) {
+    return Auxiliary::parseInteger(text, count) && count >= 1;
+}
 
 int main(int argc, char** argv){
-    if(argc!=2){
-        cout << "usage: simulation <config_path>" << endl;
+    if(argc < 2){
+        cout << USAGE << endl;
         return 0;
     }
     string configurationFile = argv[1];
-    Simulation simulation(configurationFile);
-    simulation.start();
-    if(backup!=nullptr){
-    	delete backup;
-    	backup = nullptr;
+    int threadCount = 1;
+    bool threadsGiven = false; //A sweep uses every core unless told otherwise
+    string snapshotFile;
+    bool batch = false; //--script implies it
+    string scriptFile;
+    int logCap = 0;
+    string logSpillFile; //A temporary file if not given
+    bool stats = false; //The stats command turns collecting on and off as well
+    string traceFile; //No tracing unless given
+    string sweepFile; //Runs the variants it lists instead of reading commands
+    int shardCount = 0; //Worker processes the plans are split between; none steps them in this process
+    for (int i = 2; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--threads" && i + 1 < argc) {
+            if (!parseCount(argv[++i], threadCount)) {
+                cout << USAGE << endl;
+                return 0;
+            }
+            threadsGiven = true;
+        } else if (option == "--snapshot" && i + 1 < argc) {
+            snapshotFile = argv[++i];
+        } else if (option == "--batch") {
+            batch = true;
+        } else if (option == "--script" && i + 1 < argc) {
+            batch = true;
+            scriptFile = argv[++i];
+        } else if (option == "--log-cap" && i + 1 < argc) {
+            if (!parseCount(argv[++i], logCap)) {
+                cout << USAGE << endl;
+                return 0;
+            }
+        } else if (option == "--log-spill" && i + 1 < argc) {
+            logSpillFile = argv[++i];
+        } else if (option == "--stats") {
+            stats = true;
+        } else if (option == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (option == "--sweep" && i + 1 < argc) {
+            sweepFile = argv[++i];
+        } else if (option == "--shards" && i + 1 < argc) {
+            if (!parseCount(argv[++i], shardCount)) {
+                cout << USAGE << endl;
+                return 0;
+            }
+        } else {
+            cout << USAGE << endl;
+            return 0;
+        }
+    }
+    try {
+        Simulation simulation(configurationFile, threadCount);
+        if (!sweepFile.empty()) {
+            const Sweep sweep(sweepFile);
+            if (!snapshotFile.empty()) {
+                simulation.loadSnapshot(snapshotFile);
+            }
+            sweep.run(simulation, threadsGiven ? threadCount : max(1, static_cast<int>(thread::hardware_concurrency())));
+            return 0;
+        }
+        if (shardCount > 0) {
+            if (!snapshotFile.empty()) {
+                simulation.loadSnapshot(snapshotFile);
+            }
+            //Forking only copies the calling thread, so the workers start their own pools
+            simulation.setThreadCount(1);
+            ShardPool shards(shardCount);
+            const int shard = shards.spawn();
+            if (shard < 0) {
+                if (batch) {
+                    shards.startBatch(scriptFile);
+                } else {
+                    shards.start();
+                }
+            } else {
+                //stats and trace only reach the first worker, see ShardPool::runCommand
+                simulation.setThreadCount(threadCount);
+                simulation.setLogLimit(logCap, logSpillFile.empty() ? logSpillFile : logSpillFile + "." + to_string(shard));
+                simulation.setStatsEnabled(stats && shard == 0);
+                if (!traceFile.empty() && shard == 0) {
+                    simulation.startTracing(traceFile);
+                }
+                simulation.startShard(shards.getLink(shard));
+            }
+            backups.clear();
+            undoJournal.clear();
+            return 0;
+        }
+        simulation.setLogLimit(logCap, logSpillFile);
+        simulation.setStatsEnabled(stats);
+        if (!traceFile.empty()) {
+            simulation.startTracing(traceFile);
+        }
+        if (!snapshotFile.empty()) {
+            simulation.loadSnapshot(snapshotFile);
+        }
+        if (batch) {
+            simulation.startBatch(scriptFile);
+        } else {
+            simulation.start();
+        }
+    } catch (const runtime_error &e) {
+        cout << "Error: " << e.what() << endl;
+        return 1;
     }
+    backups.clear();
+    undoJournal.clear();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,162 @@
+#include "ScenarioGenerator.h"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+using namespace std;
+
+// Writes a generated config, and optionally a command script for it, for load tests:
+//     generator --config <file> [--script <file>] [--seed <n>] [--settlements <n>] [--facilities <n>]
+//         [--plans <n>] [--settlement-mix <village:city:metropolis>] [--category-mix <life:eco:env>]
+//         [--policy-mix <nve:bal:eco:env>] [--steps <n>] [--ticks <min>[-<max>]] [--actions <percent>]
+// for example
+//     bin/generator --config big.txt --script big_script.txt --settlements 20000 --facilities 5000 --plans 100000 --steps 200 --ticks 1-50
+//     bin/simulation big.txt --script big_script.txt
+// See ScenarioGenerator.h for what the settings mean.
+
+static const char *const USAGE = "usage: generator --config <file> [--script <file>] [--seed <n>] [--settlements <n>] [--facilities <n>] [--plans <n>] "
+                                 "[--settlement-mix <village:city:metropolis>] [--category-mix <life:eco:env>] [--policy-mix <nve:bal:eco:env>] "
+                                 "[--steps <n>] [--ticks <min>[-<max>]] [--actions <percent>]";
+
+//Colon separated weights, exactly count of them
+static void parseMix(const string &text, int *weights, int count)
+{
+    size_t position = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        size_t used;
+        weights[i] = stoi(text.substr(position), &used);
+        position += used;
+        if (i + 1 < count)
+        {
+            if (position >= text.size() || text[position] != ':')
+            {
+                throw invalid_argument(text);
+            }
+            position++;
+        }
+    }
+    if (position != text.size())
+    {
+        throw invalid_argument(text);
+    }
+}
+
+static void writeFile(const string &path, const ScenarioGenerator &generator, void (ScenarioGenerator::*write)(TextWriter &) const)
+{
+    ofstream file(path, ios::binary);
+    if (!file)
+    {
+        throw runtime_error("Could not open file: " + path);
+    }
+    {
+        TextWriter out(file.rdbuf());
+        (generator.*write)(out);
+    }
+    if (!file.flush())
+    {
+        throw runtime_error("Could not write file: " + path);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ScenarioSettings settings;
+    string configPath;
+    string scriptPath;
+    try
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const string option = argv[i];
+            if (i + 1 >= argc)
+            {
+                cout << USAGE << endl;
+                return 0;
+            }
+            const string value = argv[++i];
+            if (option == "--config")
+            {
+                configPath = value;
+            }
+            else if (option == "--script")
+            {
+                scriptPath = value;
+            }
+            else if (option == "--seed")
+            {
+                settings.seed = stoull(value);
+            }
+            else if (option == "--settlements")
+            {
+                settings.settlements = stoi(value);
+            }
+            else if (option == "--facilities")
+            {
+                settings.facilities = stoi(value);
+            }
+            else if (option == "--plans")
+            {
+                settings.plans = stoi(value);
+            }
+            else if (option == "--settlement-mix")
+            {
+                parseMix(value, settings.settlementMix, 3);
+            }
+            else if (option == "--category-mix")
+            {
+                parseMix(value, settings.categoryMix, 3);
+            }
+            else if (option == "--policy-mix")
+            {
+                parseMix(value, settings.policyMix, 4);
+            }
+            else if (option == "--steps")
+            {
+                settings.steps = stoi(value);
+            }
+            else if (option == "--ticks")
+            {
+                size_t used;
+                settings.minTicks = stoi(value, &used);
+                settings.maxTicks = used < value.size() && value[used] == '-' ? stoi(value.substr(used + 1)) : settings.minTicks;
+            }
+            else if (option == "--actions")
+            {
+                settings.actionPercent = stoi(value);
+            }
+            else
+            {
+                cout << USAGE << endl;
+                return 0;
+            }
+        }
+    }
+    catch (const logic_error &)
+    {
+        //stoi and parseMix throw invalid_argument or out_of_range
+        cout << USAGE << endl;
+        return 0;
+    }
+    if (configPath.empty())
+    {
+        cout << USAGE << endl;
+        return 0;
+    }
+
+    try
+    {
+        const ScenarioGenerator generator(settings);
+        writeFile(configPath, generator, &ScenarioGenerator::writeConfig);
+        if (!scriptPath.empty())
+        {
+            writeFile(scriptPath, generator, &ScenarioGenerator::writeScript);
+        }
+    }
+    catch (const runtime_error &e)
+    {
+        cout << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}